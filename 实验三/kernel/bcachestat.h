@@ -0,0 +1,17 @@
+// 缓冲区缓存统计，bcachestat系统调用按此结构把数据复制给用户程序
+
+#define NBUCKETS_MAX 61 // 哈希桶数上限
+
+struct bucketstat {
+  uint hit;     // 命中次数
+  uint miss;    // 未命中次数
+  uint steal;   // 从其他桶换出缓存块放入本桶的次数
+  uint contend; // 加本桶锁时锁已被其他CPU持有的次数
+  uint chain;   // 当前链长
+};
+
+struct bcachestat {
+  uint nbuf;    // 当前缓存块数
+  uint nbucket; // 当前哈希桶数，bucket[]中只有前nbucket项有链长
+  struct bucketstat bucket[NBUCKETS_MAX];
+};
@@ -12,6 +12,26 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+//
+// Cache hits do not take the bucket lock: every bucket has a
+// sequence count that writers bump around any change to the
+// bucket list or to a buffer's identity, and refcnt is only
+// changed with atomic instructions.  A reader pins the buffer
+// it found and keeps it only if the sequence count did not move;
+// a lookup that misses with a steady count goes straight to
+// eviction, so neither hits nor misses take the bucket lock just
+// to search.
+//
+// Buffers are allocated a page at a time from kalloc: NBUF at
+// boot, more on misses up to a limit, and kalloc takes idle pages
+// back through bshrink when memory runs out.  The bucket count
+// follows the number of buffers, and a buffer always lives in
+// bucket blockno % nbucket.  On a miss a clock hand sweeps the
+// buffers, giving each recently released buffer a second chance,
+// and takes the first free buffer it has passed once already.
+// Misses, growth, shrinking and rehashing are serialized by
+// evictlock, which also makes it safe to hold several bucket
+// locks at once.
 
 
 #include "types.h"
@@ -22,39 +42,347 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "bcachestat.h"
+
+#define NBUCKETS 13     // 哈希桶数下限
+#define BPP (PGSIZE / (sizeof(struct buf) + sizeof(uint) + sizeof(uchar))) // 每页缓存块数
+#define NBUFPAGE_MIN ((NBUF + BPP - 1) / BPP) // 启动时分配的页数，内存紧张时也不回收，保证文件系统够用
+#define NBUFPAGE_MAX (NBUFPAGE_MIN * 8)       // 按需扩容的上限
+#define NFASTRETRY 4    // 无锁查找遇到并发修改时的重查次数
+
+// 一页缓存块。lastuse和访问位放在页内，brelse由缓存块地址即可找到
+struct bpage {
+  uint lastuse[BPP]; // 每个缓存块最近一次brelse时的ticks，缩容时选最久未用的页
+  uchar used[BPP];   // 访问位，brelse置1，时钟指针经过时清0
+  struct buf buf[BPP];
+};
 
-#define NBUCKETS 13
+// 每个CPU上按桶号累计的计数，只在关中断时由本CPU修改。
+// 调整桶数后，旧计数仍记在原来的桶号下
+enum { BS_HIT, BS_MISS, BS_STEAL, BS_CONTEND, BS_N };
+
+struct bcpustat {
+  uint n[NBUCKETS_MAX][BS_N];
+} __attribute__((aligned(64)));
+
+static int bucketsizes[] = { NBUCKETS, 31, NBUCKETS_MAX }; // 哈希桶数在这几个素数间调整
 
 struct {
-  struct spinlock lock[NBUCKETS];
-  struct buf buf[NBUF];
+  struct spinlock lock[NBUCKETS_MAX];
+  struct spinlock evictlock; // 换出、扩容、缩容和调整桶数时持有，只有持有者会同时持有多个桶锁
+  struct bpage *page[NBUFPAGE_MAX]; // 已分配的缓存页，只在持有evictlock时访问
+  int npage;
+  int nbucket; // 当前哈希桶数，只在持有evictlock和全部桶锁时修改
+  int hand;    // 时钟指针，第hand/BPP页的第hand%BPP个缓存块，只在持有evictlock时访问
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf hashbucket[NBUCKETS]; //利用哈希表存取不同key值得缓存块，每个哈希桶配备一个lock锁
+  // Linked list of buffers in each bucket, through prev/next.
+  struct buf hashbucket[NBUCKETS_MAX]; //利用哈希表存取不同key值得缓存块，每个哈希桶配备一个lock锁
+  uint seq[NBUCKETS_MAX]; // 哈希桶的顺序计数，奇数表示正在修改，只在持有对应lock时修改
+  uint readseq[NCPU]; // 各CPU上无锁查找的计数，奇数表示正在查找，缩容据此等待查找结束再释放页
+  struct bcpustat cpu[NCPU]; // 各CPU分别计数，避免计数器在CPU间来回传递
 } bcache;
 
+static struct bpage*
+bpageof(struct buf *b)
+{
+  return (struct bpage*)PGROUNDDOWN((uint64)b);
+}
+
+static void
+bcount(int bucket, int what, int n)
+{
+  push_off();
+  bcache.cpu[cpuid()].n[bucket][what] += n;
+  pop_off();
+}
+
+// 给bget路径上的桶加锁，锁已被持有时记一次争用
+static void
+bacquire(int bucket)
+{
+  push_off();
+  if(__atomic_load_n(&bcache.lock[bucket].locked, __ATOMIC_RELAXED))
+    bcache.cpu[cpuid()].n[bucket][BS_CONTEND]++;
+  acquire(&bcache.lock[bucket]);
+  pop_off();
+}
+
+// 持有bcache.lock[bucket]时，修改桶内链表或缓存块的dev/blockno前调用
+static void
+bucket_write_begin(int bucket)
+{
+  __atomic_store_n(&bcache.seq[bucket], bcache.seq[bucket] + 1, __ATOMIC_RELAXED);
+  __sync_synchronize(); // 计数先于后续修改可见
+}
+
+static void
+bucket_write_end(int bucket)
+{
+  __sync_synchronize(); // 修改先于计数可见
+  __atomic_store_n(&bcache.seq[bucket], bcache.seq[bucket] + 1, __ATOMIC_RELAXED);
+}
+
+// 把b插到bucket链表头部，调用者持有该桶的锁并处于写区间内
+static void
+blink(struct buf *b, int bucket)
+{
+  b->next = bcache.hashbucket[bucket].next;
+  b->prev = &bcache.hashbucket[bucket];
+  bcache.hashbucket[bucket].next->prev = b;
+  bcache.hashbucket[bucket].next = b;
+}
+
+static void
+bunlink(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+}
+
+// 空闲缓存块（refcnt为0）才能被换出，用CAS占用，与无锁命中路径的refcnt++互斥
+static int
+bclaim(struct buf *b)
+{
+  uint zero = 0;
+  return __atomic_compare_exchange_n(&b->refcnt, &zero, 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+// 换出策略（时钟算法）：指针在全部缓存块上循环，跳过被引用的块；访问位为1的
+// 空闲块清0后放过一次，遇到访问位为0的空闲块即选中。新分配的缓存块访问位为0，
+// 扩容后指针指向新页，会被最先选中。每清一次访问位对应一次brelse，均摊O(1)。
+// 调用者持有evictlock；结果只是候选，仍须用bclaim占用
+static struct buf*
+bclock(void)
+{
+  int n = bcache.npage * BPP;
+  for(int i = 0; i < 2 * n; i++){ // 转两圈：第一圈清掉的访问位，第二圈不会再拦住
+    struct bpage *p = bcache.page[bcache.hand / BPP];
+    int k = bcache.hand % BPP;
+    if(++bcache.hand == n)
+      bcache.hand = 0;
+    if(__atomic_load_n(&p->buf[k].refcnt, __ATOMIC_RELAXED) != 0)
+      continue;
+    if(__atomic_load_n(&p->used[k], __ATOMIC_RELAXED)){
+      __atomic_store_n(&p->used[k], 0, __ATOMIC_RELAXED);
+      continue;
+    }
+    return &p->buf[k];
+  }
+  return 0;
+}
+
+// 按缓存块数调整哈希桶数，平均链长保持在1到4之间。调用者持有evictlock，不持有桶锁
+static void
+bresize(void)
+{
+  int nbuf = bcache.npage * BPP, n = bcache.nbucket, i;
+
+  for(i = 0; bucketsizes[i] != n; i++)
+    ;
+  if(nbuf > 4 * n && i + 1 < NELEM(bucketsizes))
+    n = bucketsizes[i + 1];
+  else if(nbuf < n && i > 0)
+    n = bucketsizes[i - 1];
+  else
+    return;
+
+  // 全部桶进入写区间，无锁查找都会失败重试
+  for(i = 0; i < NBUCKETS_MAX; i++){
+    acquire(&bcache.lock[i]);
+    bucket_write_begin(i);
+    bcache.hashbucket[i].prev = &bcache.hashbucket[i];
+    bcache.hashbucket[i].next = &bcache.hashbucket[i];
+  }
+  for(i = 0; i < bcache.npage; i++){
+    for(struct buf *b = bcache.page[i]->buf; b < bcache.page[i]->buf + BPP; b++)
+      blink(b, b->blockno % n);
+  }
+  __atomic_store_n(&bcache.nbucket, n, __ATOMIC_RELEASE);
+  for(i = 0; i < NBUCKETS_MAX; i++){
+    bucket_write_end(i);
+    release(&bcache.lock[i]);
+  }
+}
+
+// 申请一页新的缓存块放入0号桶，新块valid为0，下一次换出时最先被选中。
+// 调用者持有evictlock；不向缓存自己回收内存，否则会拆一页补一页
+static int
+bgrow(void)
+{
+  struct bpage *p;
+  struct buf *b;
+
+  if(bcache.npage >= NBUFPAGE_MAX || (p = kallocnocache()) == 0)
+    return 0;
+  memset(p, 0, sizeof(*p));
+  acquire(&bcache.lock[0]);
+  bucket_write_begin(0);
+  for(b = p->buf; b < p->buf + BPP; b++){
+    initsleeplock(&b->lock, "buffer");
+    blink(b, 0);
+  }
+  bucket_write_end(0);
+  release(&bcache.lock[0]);
+  bcache.hand = bcache.npage * BPP;
+  bcache.page[bcache.npage++] = p;
+  return 1;
+}
+
+// 等待此前已开始的无锁查找全部结束，之后摘下的缓存块不会再被访问
+static void
+bwaitreaders(void)
+{
+  for(int i = 0; i < NCPU; i++){
+    uint s = __atomic_load_n(&bcache.readseq[i], __ATOMIC_SEQ_CST);
+    while((s & 1) && __atomic_load_n(&bcache.readseq[i], __ATOMIC_SEQ_CST) == s)
+      ;
+  }
+}
+
+// 内存耗尽时由kalloc调用：交还一页全部空闲、且最久未用的缓存页，
+// 不低于NBUFPAGE_MIN页。返回交还的页数
+int
+bshrink(void)
+{
+  struct bpage *p;
+  struct buf *b;
+  int victim = -1, i, k;
+  uint oldest = 0;
+  int held[BPP], nheld = 0, claimed;
+
+  acquire(&bcache.evictlock);
+  if(bcache.npage <= NBUFPAGE_MIN){
+    release(&bcache.evictlock);
+    return 0;
+  }
+  // 以页内最近一次使用的时间为准，选最早的
+  for(i = 0; i < bcache.npage; i++){
+    p = bcache.page[i];
+    uint newest = p->lastuse[0];
+    for(k = 0; k < BPP; k++){
+      if(__atomic_load_n(&p->buf[k].refcnt, __ATOMIC_RELAXED) != 0)
+        break;
+      if((int)(p->lastuse[k] - newest) > 0)
+        newest = p->lastuse[k];
+    }
+    if(k == BPP && (victim < 0 || (int)(newest - oldest) < 0)){
+      victim = i;
+      oldest = newest;
+    }
+  }
+  if(victim < 0){
+    release(&bcache.evictlock);
+    return 0;
+  }
+
+  // 同时持有页内缓存块所在的各个桶锁，要么全部占用后摘下，要么全部放弃
+  p = bcache.page[victim];
+  for(k = 0; k < BPP; k++){
+    int bk = p->buf[k].blockno % bcache.nbucket;
+    for(i = 0; i < nheld && held[i] != bk; i++)
+      ;
+    if(i == nheld){
+      held[nheld++] = bk;
+      acquire(&bcache.lock[bk]);
+      bucket_write_begin(bk);
+    }
+  }
+  for(k = 0; k < BPP && bclaim(&p->buf[k]); k++)
+    ;
+  claimed = k == BPP;
+  if(claimed){
+    for(b = p->buf; b < p->buf + BPP; b++)
+      bunlink(b);
+  } else {
+    while(--k >= 0)
+      __atomic_fetch_sub(&p->buf[k].refcnt, 1, __ATOMIC_SEQ_CST);
+  }
+  for(i = 0; i < nheld; i++){
+    bucket_write_end(held[i]);
+    release(&bcache.lock[held[i]]);
+  }
+  if(!claimed){
+    release(&bcache.evictlock);
+    return 0;
+  }
+  bcache.page[victim] = bcache.page[--bcache.npage];
+  if(bcache.hand >= bcache.npage * BPP)
+    bcache.hand = 0;
+  bresize();
+  release(&bcache.evictlock);
+
+  bwaitreaders();
+  kfree(p);
+  return 1;
+}
+
+// 不加锁查找命中的缓存块。找到后先增加引用计数把它钉住，再确认桶在此期间
+// 没有被修改；否则撤销引用重查，重查NFASTRETRY次仍不成功才返回0交给加锁路径。
+// 没找到且桶在查找期间没有被修改时*absent置1，调用者不必再加桶锁查找
+static struct buf*
+bget_fast(uint dev, uint blockno, int *absent)
+{
+  struct buf *b, *found = 0;
+
+  *absent = 0;
+  push_off(); // 查找期间不让出CPU，缩容按CPU等待查找结束
+  int id = cpuid();
+  __atomic_fetch_add(&bcache.readseq[id], 1, __ATOMIC_SEQ_CST);
+
+  for(int try = 0; try < NFASTRETRY && !found && !*absent; try++){
+    int bucket = blockno % __atomic_load_n(&bcache.nbucket, __ATOMIC_ACQUIRE);
+    uint seq = __atomic_load_n(&bcache.seq[bucket], __ATOMIC_ACQUIRE);
+    int steps = 0;
+    if(seq & 1)
+      continue;
+    // 并发修改可能让遍历走进别的桶，最多走NBUFPAGE_MAX*BPP步，结果由顺序计数把关。
+    // 桶数在读取后被调整也无妨：调整会改变所有桶的顺序计数
+    for(b = bcache.hashbucket[bucket].next; b != &bcache.hashbucket[bucket] && steps < NBUFPAGE_MAX * BPP; b = b->next, steps++){
+      if(b->dev == dev && b->blockno == blockno){
+        __atomic_fetch_add(&b->refcnt, 1, __ATOMIC_SEQ_CST);
+        if(b->dev == dev && b->blockno == blockno &&
+           __atomic_load_n(&bcache.seq[bucket], __ATOMIC_SEQ_CST) == seq)
+          found = b;
+        else
+          __atomic_fetch_sub(&b->refcnt, 1, __ATOMIC_SEQ_CST);
+        break;
+      }
+    }
+    if(!found && b == &bcache.hashbucket[bucket] &&
+       __atomic_load_n(&bcache.seq[bucket], __ATOMIC_SEQ_CST) == seq)
+      *absent = 1;
+  }
+
+  __atomic_fetch_add(&bcache.readseq[id], 1, __ATOMIC_SEQ_CST);
+  pop_off();
+  return found;
+}
+
 void
 binit(void)
 {
-  struct buf *b;
-  for(int count = 0; count < NBUCKETS; count++){
+  if(sizeof(struct bpage) > PGSIZE)
+    panic("binit: bpage");
+  if(NBUFPAGE_MAX * BPP > 4 * NBUCKETS_MAX) // 缓存长到上限时平均链长仍不超过4
+    panic("binit: buckets");
+  initlock(&bcache.evictlock, "bcache.evict");
+  for(int count = 0; count < NBUCKETS_MAX; count++){
     initlock(&bcache.lock[count], "bcache"); // 初始化每个哈希桶的lock锁
     bcache.hashbucket[count].prev = &bcache.hashbucket[count]; // hashbucket[count]的prev连接hashbucket[count]
     bcache.hashbucket[count].next = &bcache.hashbucket[count]; // hashbucket[count]的next连接hashbucket[count]
   }
+  bcache.nbucket = NBUCKETS;
   // Create linked list of buffers
-  // 用prev和next节点连接bcache.hashbucket[count]和bcache.buf节点，为每个哈希桶分配等数量缓存块
-  int count = 0;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++,count++){
-    count = count % NBUCKETS;
-    b->next = bcache.hashbucket[count].next;
-    b->prev = &bcache.hashbucket[count];
-    initsleeplock(&b->lock, "buffer");
-    bcache.hashbucket[count].next->prev = b;
-    bcache.hashbucket[count].next = b;
+  // 缓存块从kalloc按页申请，启动时只分配文件系统所需的NBUF个，其余按需扩容。
+  // 未使用的缓存块blockno为0，按所在桶=blockno%nbucket的约定放入0号桶，
+  // 第一次被换出时再移到目标桶
+  acquire(&bcache.evictlock);
+  while(bcache.npage < NBUFPAGE_MIN){
+    if(!bgrow())
+      panic("binit: no memory");
   }
+  bresize();
+  release(&bcache.evictlock);
 }
 
 // Look through buffer cache for block on device dev.
@@ -64,66 +392,106 @@ static struct buf*
 bget(uint dev, uint blockno)
 {
   struct buf *b;
-  int currentCount = blockno % NBUCKETS;// 得到当前哈希桶号
+  int currentCount, absent;
+
+  // 命中时不加锁
+  if((b = bget_fast(dev, blockno, &absent)) != 0){
+    bcount(blockno % __atomic_load_n(&bcache.nbucket, __ATOMIC_RELAXED), BS_HIT, 1);
+    acquiresleep(&b->lock);
+    return b;
+  }
 
-  acquire(&bcache.lock[currentCount]);//当前哈希桶加锁
+  // 确定未缓存时直接换出，持有evictlock后还会再查一次
+  if(absent)
+    goto again;
+
+  // 桶数可能在加锁前被调整，加锁后桶数不变才算锁对了桶
+  for(;;){
+    int n = __atomic_load_n(&bcache.nbucket, __ATOMIC_ACQUIRE);
+    currentCount = blockno % n;// 得到当前哈希桶号
+    bacquire(currentCount);//当前哈希桶加锁
+    if(n == bcache.nbucket)
+      break;
+    release(&bcache.lock[currentCount]);
+  }
 
   // Is the block already cached?
-  // 先从当前哈希桶中找到命中缓存块
+  // 加锁后再找一次：可能与其他进程同时未命中，或无锁查找因并发修改而放弃
   for(b = bcache.hashbucket[currentCount].next; b != &bcache.hashbucket[currentCount]; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
+      __atomic_fetch_add(&b->refcnt, 1, __ATOMIC_SEQ_CST);
       release(&bcache.lock[currentCount]);//当前哈希桶解锁
+      bcount(currentCount, BS_HIT, 1);
       acquiresleep(&b->lock);
       return b;
     }
   }
 
+  release(&bcache.lock[currentCount]);//当前哈希桶解锁
+
   // Not cached.
-  // 若从当前哈希桶中没有命中缓存块，再从当前哈希桶中找到一个空闲缓存
-  for(b = bcache.hashbucket[currentCount].prev; b != &bcache.hashbucket[currentCount]; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock[currentCount]);//当前哈希桶解锁
+  // 持有evictlock后再加锁查一次，期间可能已有其他进程读入了该块
+again:
+  acquire(&bcache.evictlock);
+  currentCount = blockno % bcache.nbucket;
+  bacquire(currentCount);
+  for(b = bcache.hashbucket[currentCount].next; b != &bcache.hashbucket[currentCount]; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      release(&bcache.lock[currentCount]);
+      __atomic_fetch_add(&b->refcnt, 1, __ATOMIC_SEQ_CST);
+      release(&bcache.evictlock);
+      bcount(currentCount, BS_HIT, 1);
       acquiresleep(&b->lock);
       return b;
     }
   }
+  release(&bcache.lock[currentCount]);
 
-  // Not cached.
-  // 若当前哈希桶中找不到空闲缓存，则从其他哈希桶中找到一个空闲缓存存入该哈希桶列表头部
-  for(int findCount = currentCount + 1; findCount != currentCount; findCount++){
-    findCount = findCount % NBUCKETS;
-    if(bcache.lock[findCount].locked){//如果当前锁锁住就跳过
+  // 时钟指针选中的块已装有数据且未达上限时先扩容一页，改选新页中的缓存块；
+  // 扩容可能调整桶数。持有evictlock，其他进程不会在此期间读入该块，不必再查
+  b = bclock();
+  if((b == 0 || b->valid) && bgrow()){
+    bresize();
+    b = bclock();
+  }
+  currentCount = blockno % bcache.nbucket;
+  bacquire(currentCount);
+
+  // 占用失败说明选中后刚被无锁命中钉住，指针继续向前重选
+  for(; b != 0; b = bclock()){
+    int victimCount = b->blockno % bcache.nbucket; // 只有持有evictlock的进程会改blockno，这里读到的是稳定值
+    if(victimCount != currentCount)
+      bacquire(victimCount);
+    bucket_write_begin(victimCount);
+    if(!bclaim(b)){
+      bucket_write_end(victimCount);
+      if(victimCount != currentCount)
+        release(&bcache.lock[victimCount]);
       continue;
     }
-    acquire(&bcache.lock[findCount]);//搜查空闲缓存块哈希桶加锁
-    for(b = bcache.hashbucket[findCount].prev; b != &bcache.hashbucket[findCount]; b = b->prev){
-      if(b->refcnt == 0) {
-        //将该缓存移入当前哈希桶头部
-        b->next->prev = b->prev;
-        b->prev->next = b->next;
-        b->next = bcache.hashbucket[currentCount].next;
-        b->prev = &bcache.hashbucket[currentCount];
-        bcache.hashbucket[currentCount].next->prev = b;
-        bcache.hashbucket[currentCount].next = b;
-
-        b->dev = dev;
-        b->blockno = blockno;
-        b->valid = 0;
-        b->refcnt = 1;
-        release(&bcache.lock[findCount]);//搜查空闲缓存块哈希桶解锁
-        release(&bcache.lock[currentCount]);//当前哈希桶解锁
-        acquiresleep(&b->lock);
-        return b;
-      }
+    if(victimCount != currentCount)
+      bucket_write_begin(currentCount);
+    //将该缓存移入当前哈希桶头部
+    bunlink(b);
+    blink(b, currentCount);
+
+    b->dev = dev;
+    b->blockno = blockno;
+    b->valid = 0;
+    if(victimCount != currentCount){
+      bucket_write_end(currentCount);
+      bucket_write_end(victimCount);
+      release(&bcache.lock[victimCount]);
+      bcount(currentCount, BS_STEAL, 1);
+    } else {
+      bucket_write_end(victimCount);
     }
-    release(&bcache.lock[findCount]);//搜查空闲缓存块哈希桶解锁
+    release(&bcache.lock[currentCount]);//当前哈希桶解锁
+    release(&bcache.evictlock);
+    bcount(currentCount, BS_MISS, 1);
+    acquiresleep(&b->lock);
+    return b;
   }
-  release(&bcache.lock[currentCount]);//当前哈希桶解锁
   panic("bget: no buffers");
 }
 
@@ -151,45 +519,88 @@ bwrite(struct buf *b)
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Set the buffer's clock reference bit and record the release
+// tick in lastuse, which bshrink uses to pick a page, and drop
+// the reference.
 void
 brelse(struct buf *b)
-{ 
-  int currentCount = b->blockno % NBUCKETS;// 得到当前哈希桶号
-  
+{
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
-  acquire(&bcache.lock[currentCount]);// 当前哈希桶加锁
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    //将该缓存移入当前哈希桶头部
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.hashbucket[currentCount].next;
-    b->prev = &bcache.hashbucket[currentCount];
-    bcache.hashbucket[currentCount].next->prev = b;
-    bcache.hashbucket[currentCount].next = b;
-  }
-  release(&bcache.lock[currentCount]);// 当前哈希桶解锁
+  bpageof(b)->lastuse[b - bpageof(b)->buf] = ticks;
+  __atomic_store_n(&bpageof(b)->used[b - bpageof(b)->buf], 1, __ATOMIC_RELAXED); // 只置访问位，无需维护链表顺序
+  __atomic_fetch_sub(&b->refcnt, 1, __ATOMIC_SEQ_CST);
 }
 
+// 调用者持有该缓存块的引用，不会被换出，引用计数原子增减即可
 void
 bpin(struct buf *b) {
-  int currentCount = b->blockno % NBUCKETS;// 得到当前哈希桶号
-  acquire(&bcache.lock[currentCount]);// 当前哈希桶加锁
-  b->refcnt++;
-  release(&bcache.lock[currentCount]);// 当前哈希桶解锁
+  __atomic_fetch_add(&b->refcnt, 1, __ATOMIC_SEQ_CST);
 }
 
 void
 bunpin(struct buf *b) {
-  int currentCount = b->blockno % NBUCKETS;// 得到当前哈希桶号
-  acquire(&bcache.lock[currentCount]);// 当前哈希桶加锁
-  b->refcnt--;
-  release(&bcache.lock[currentCount]);// 当前哈希桶解锁
+  __atomic_fetch_sub(&b->refcnt, 1, __ATOMIC_SEQ_CST);
+}
+
+
+
+// 汇总第i个桶在各CPU上的计数，并在桶锁下数出链长
+static void
+bsnapbucket(int i, struct bucketstat *bs)
+{
+  struct buf *b;
+
+  memset(bs, 0, sizeof(*bs));
+  for(int c = 0; c < NCPU; c++){
+    uint *n = bcache.cpu[c].n[i];
+    bs->hit += n[BS_HIT];
+    bs->miss += n[BS_MISS];
+    bs->steal += n[BS_STEAL];
+    bs->contend += n[BS_CONTEND];
+  }
+  acquire(&bcache.lock[i]);
+  for(b = bcache.hashbucket[i].next; b != &bcache.hashbucket[i]; b = b->next)
+    bs->chain++;
+  release(&bcache.lock[i]);
 }
 
+// bcachestat系统调用：把统计复制到用户地址addr。整个结构超过一页，逐桶汇总、逐桶复制
+int
+bcachestat(uint64 addr)
+{
+  struct bcachestat *u = (struct bcachestat*)addr; // 只用来算用户地址中各字段的位置，不解引用
+  struct bucketstat bs;
+  uint nbuf = __atomic_load_n(&bcache.npage, __ATOMIC_RELAXED) * BPP;
+  uint nbucket = __atomic_load_n(&bcache.nbucket, __ATOMIC_RELAXED);
 
+  if(either_copyout(1, (uint64)&u->nbuf, &nbuf, sizeof(nbuf)) < 0 ||
+     either_copyout(1, (uint64)&u->nbucket, &nbucket, sizeof(nbucket)) < 0)
+    return -1;
+  for(int i = 0; i < NBUCKETS_MAX; i++){
+    bsnapbucket(i, &bs);
+    if(either_copyout(1, (uint64)&u->bucket[i], &bs, sizeof(bs)) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// 打印缓冲区缓存的大小和命中统计，供调试入口调用
+void
+bcachedump(void)
+{
+  struct bucketstat bs;
+  uint hit = 0, miss = 0, steal = 0, contend = 0;
+
+  for(int i = 0; i < NBUCKETS_MAX; i++){
+    bsnapbucket(i, &bs);
+    hit += bs.hit;
+    miss += bs.miss;
+    steal += bs.steal;
+    contend += bs.contend;
+  }
+  printf("bcache: %d bufs, %d buckets, hit %d miss %d steal %d contend %d\n",
+         bcache.npage * BPP, bcache.nbucket, hit, miss, steal, contend);
+}
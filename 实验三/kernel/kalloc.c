@@ -68,11 +68,9 @@ kfree(void *pa)
   release(&kmems[cpu_id].lock); // 解锁
 }
 
-// Allocate one 4096-byte page of physical memory.
-// Returns a pointer that the kernel can use.
-// Returns 0 if the memory cannot be allocated.
+// 不向缓冲区缓存回收内存的kalloc，供缓冲区缓存自身扩容使用
 void *
-kalloc(void)
+kallocnocache(void)
 {
   struct run *r;
   push_off();
@@ -102,3 +100,16 @@ kalloc(void)
   }
   return 0;// 若没有找到空闲内存空间则返回0
 }
+
+// Allocate one 4096-byte page of physical memory.
+// Returns a pointer that the kernel can use.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc(void)
+{
+  void *r = kallocnocache();
+  // 内存耗尽时让缓冲区缓存交还一页空闲缓存块再试
+  if(r == 0 && bshrink())
+    r = kallocnocache();
+  return r;
+}
@@ -0,0 +1,93 @@
+#include "ddriver.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/******************************************************************************
+* SECTION: 文件模拟的ddriver
+*
+* 以普通文件充当磁盘（至少4MB，grow.newfs扩展过的镜像按文件实际大小），
+* 接口与libddriver.a一致（512字节IO单位、需先seek），供进程内基准直接链接文件系统实现使用。
+*******************************************************************************/
+#define DDRIVER_FILE_SIZE       (4 * 1024 * 1024)
+#define DDRIVER_FILE_IO_SZ      512
+
+static off_t                ddriver_file_pos = 0;
+static off_t                ddriver_file_sz  = DDRIVER_FILE_SIZE;
+static struct ddriver_state ddriver_file_state;
+
+int ddriver_open(char *path) {
+    struct stat st;
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        return -1;
+    }
+    if (st.st_size < DDRIVER_FILE_SIZE && ftruncate(fd, DDRIVER_FILE_SIZE) != 0) {
+        return -1;
+    }
+    ddriver_file_sz  = st.st_size < DDRIVER_FILE_SIZE ? DDRIVER_FILE_SIZE : st.st_size;
+    ddriver_file_pos = 0;
+    return fd;
+}
+
+int ddriver_seek(int fd, off_t offset, int whence) {
+    if (whence != SEEK_SET || offset % DDRIVER_FILE_IO_SZ != 0 ||
+        offset < 0 || offset >= ddriver_file_sz) {
+        return -1;
+    }
+    ddriver_file_pos = offset;
+    ddriver_file_state.seek_cnt++;
+    return 0;
+}
+
+int ddriver_write(int fd, char *buf, size_t size) {
+    if (size != DDRIVER_FILE_IO_SZ ||
+        pwrite(fd, buf, size, ddriver_file_pos) != (ssize_t)size) {
+        return -1;
+    }
+    ddriver_file_pos += size;
+    ddriver_file_state.write_cnt++;
+    return 0;
+}
+
+int ddriver_read(int fd, char *buf, size_t size) {
+    if (size != DDRIVER_FILE_IO_SZ ||
+        pread(fd, buf, size, ddriver_file_pos) != (ssize_t)size) {
+        return -1;
+    }
+    ddriver_file_pos += size;
+    ddriver_file_state.read_cnt++;
+    return 0;
+}
+
+int ddriver_ioctl(int fd, unsigned long cmd, void *ret) {
+    struct stat st;
+    switch (cmd) {
+    case IOC_REQ_DEVICE_SIZE:                         /* 镜像可能在挂载期间被扩展 */
+        if (fstat(fd, &st) == 0 && st.st_size > ddriver_file_sz) {
+            ddriver_file_sz = st.st_size;
+        }
+        *(int *)ret = (int)ddriver_file_sz;
+        return 0;
+    case IOC_REQ_DEVICE_IO_SZ:
+        *(int *)ret = DDRIVER_FILE_IO_SZ;
+        return 0;
+    case IOC_REQ_DEVICE_STATE:
+        *(struct ddriver_state *)ret = ddriver_file_state;
+        return 0;
+    case IOC_REQ_DEVICE_RESET:
+        ddriver_file_state.read_cnt  = 0;
+        ddriver_file_state.write_cnt = 0;
+        ddriver_file_state.seek_cnt  = 0;
+        ddriver_file_sz = DDRIVER_FILE_SIZE;
+        return ftruncate(fd, 0) == 0 && ftruncate(fd, DDRIVER_FILE_SIZE) == 0 ? 0 : -1;
+    default:
+        return -1;
+    }
+}
+
+int ddriver_close(int fd) {
+    return close(fd);
+}
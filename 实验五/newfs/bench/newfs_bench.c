@@ -0,0 +1,162 @@
+#include "newfs.h"
+#include <getopt.h>
+
+/******************************************************************************
+* SECTION: 进程内基准
+*
+* 直接调用newfs.c中的实现（不经过FUSE与内核），磁盘由ddriver_file.c以普通文件
+* 模拟。依次测量 mount / mkdir / mknod / getattr / write / read / umount，
+* 以及重新挂载后的冷读，输出每阶段的吞吐与p50/p99延迟。
+*******************************************************************************/
+#define BENCH_DIR_FILES         50              /* 每个目录放的文件数，目录最多容纳56项 */
+
+extern struct custom_options newfs_options;
+
+struct bench_phase {
+    const char*     name;
+    int             ops;
+    uint64_t        total_ns;
+    uint64_t*       lat;
+};
+
+static int bench_cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_report(struct bench_phase* phase) {
+    uint64_t p50, p99;
+    qsort(phase->lat, phase->ops, sizeof(uint64_t), bench_cmp_u64);
+    p50 = phase->lat[(phase->ops - 1) * 50 / 100];
+    p99 = phase->lat[(phase->ops - 1) * 99 / 100];
+    printf("%-10s %8d %12.0f %10lu %10lu\n", phase->name, phase->ops,
+           phase->total_ns ? phase->ops * 1e9 / phase->total_ns : 0.0, p50, p99);
+}
+
+static void bench_path(char* path, int i) {
+    sprintf(path, "/d%d/f%d", i / BENCH_DIR_FILES, i);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "usage: %s [-d image] [-n files] [-s file_size] [-b io_size] [-c] [-u]\n"
+                    "  -c  mount with --compress\n"
+                    "  -u  mount with --dedup\n", prog);
+}
+
+int main(int argc, char** argv) {
+    const char* image     = "./newfs_bench.img";
+    int         nfiles    = 500;
+    int         file_size = 4096;
+    int         io_size   = 1024;
+    int         nops, opt, ret = 0;
+    char        path[64];
+    char*       wbuf;
+    char*       rbuf;
+    uint64_t    start, t;
+    struct stat st;
+    struct bench_phase mount_p  = { "mount" },   mkdir_p = { "mkdir" },  mknod_p = { "mknod" },
+                       getattr_p = { "getattr" }, write_p = { "write" }, read_p  = { "read" },
+                       umount_p = { "umount" },  remount_p = { "remount" }, cold_p = { "read_cold" };
+    struct bench_phase* phases[] = { &mount_p, &mkdir_p, &mknod_p, &getattr_p, &write_p,
+                                     &read_p, &umount_p, &remount_p, &cold_p };
+
+    while ((opt = getopt(argc, argv, "d:n:s:b:cuh")) != -1) {
+        switch (opt) {
+        case 'd': image     = optarg;       break;
+        case 'n': nfiles    = atoi(optarg); break;
+        case 's': file_size = atoi(optarg); break;
+        case 'b': io_size   = atoi(optarg); break;
+        case 'c': newfs_options.compress = 1; break;
+        case 'u': newfs_options.dedup    = 1; break;
+        default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (nfiles <= 0 || io_size <= 0 || file_size <= 0 || file_size % io_size != 0 ||
+        file_size > NEWFS_DATA_PER_FILE * NEWFS_DATA_SIZE) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    newfs_options.device     = image;
+    newfs_options.scrub_rate = 0;
+    newfs_options.log_level  = NEWFS_LOG_ERR;
+    nops  = nfiles * (file_size / io_size);
+    wbuf  = (char *)malloc(file_size);
+    rbuf  = (char *)malloc(file_size);
+    for (int i = 0; i < (int)(sizeof(phases) / sizeof(phases[0])); i++) {
+        phases[i]->lat = (uint64_t *)calloc(nops > nfiles ? nops : nfiles, sizeof(uint64_t));
+    }
+    for (int i = 0; i < file_size; i++) {
+        wbuf[i] = (char)(i * 131 + i / 97);
+    }
+
+#define BENCH_TIMED(phase, call) do { \
+        start = newfs_stats_now(); \
+        call; \
+        t = newfs_stats_now() - start; \
+        (phase).lat[(phase).ops++] = t; \
+        (phase).total_ns += t; \
+    } while (0)
+
+    unlink(image);
+    BENCH_TIMED(mount_p, newfs_init(NULL));
+    for (int d = 0; d * BENCH_DIR_FILES < nfiles; d++) {
+        sprintf(path, "/d%d", d);
+        BENCH_TIMED(mkdir_p, ret |= newfs_mkdir(path, S_IFDIR | 0755));
+    }
+    for (int i = 0; i < nfiles; i++) {
+        bench_path(path, i);
+        BENCH_TIMED(mknod_p, ret |= newfs_mknod(path, S_IFREG | 0644, 0));
+    }
+    for (int i = 0; i < nfiles; i++) {
+        bench_path(path, i);
+        BENCH_TIMED(getattr_p, ret |= newfs_getattr(path, &st));
+    }
+    if (ret != 0) {
+        fprintf(stderr, "namespace phase failed: %d\n", ret);
+        return 1;
+    }
+    for (int i = 0; i < nfiles; i++) {
+        bench_path(path, i);
+        for (int off = 0; off < file_size; off += io_size) {
+            BENCH_TIMED(write_p, ret = newfs_write(path, wbuf + off, io_size, off, NULL));
+            if (ret != io_size) {
+                fprintf(stderr, "write %s@%d failed: %d\n", path, off, ret);
+                return 1;
+            }
+        }
+    }
+    for (int i = 0; i < nfiles; i++) {
+        bench_path(path, i);
+        for (int off = 0; off < file_size; off += io_size) {
+            BENCH_TIMED(read_p, ret = newfs_read(path, rbuf + off, io_size, off, NULL));
+        }
+    }
+    BENCH_TIMED(umount_p, newfs_destroy(NULL));
+    BENCH_TIMED(remount_p, newfs_init(NULL));
+    for (int i = 0; i < nfiles; i++) {
+        bench_path(path, i);
+        for (int off = 0; off < file_size; off += io_size) {
+            BENCH_TIMED(cold_p, ret = newfs_read(path, rbuf + off, io_size, off, NULL));
+        }
+        if (memcmp(rbuf, wbuf, file_size) != 0) {            /* 基准同时校验数据落盘正确 */
+            fprintf(stderr, "data mismatch on %s after remount\n", path);
+            return 1;
+        }
+    }
+    newfs_destroy(NULL);
+#undef BENCH_TIMED
+
+    printf("files %d, file_size %d, io_size %d%s%s\n", nfiles, file_size, io_size,
+           newfs_options.compress ? ", compress" : "", newfs_options.dedup ? ", dedup" : "");
+    printf("%-10s %8s %12s %10s %10s\n", "phase", "ops", "ops/sec", "p50_ns", "p99_ns");
+    for (int i = 0; i < (int)(sizeof(phases) / sizeof(phases[0])); i++) {
+        if (phases[i]->ops != 0) {
+            bench_report(phases[i]);
+        }
+        free(phases[i]->lat);
+    }
+    free(wbuf);
+    free(rbuf);
+    return 0;
+}
@@ -5,12 +5,17 @@
 #include "stdio.h"
 #include "stdlib.h"
 #include <unistd.h>
+#include <sys/resource.h>
 #include "fcntl.h"
 #include "string.h"
 #include "fuse.h"
 #include <stddef.h>
 #include "ddriver.h"
 #include "errno.h"
+#include <linux/falloc.h>
+#include <sys/xattr.h>
+#include <time.h>
+
 #include "types.h"
 #include <stdbool.h>
 
@@ -37,8 +42,59 @@ int   			   newfs_rmdir(const char *);
 int   			   newfs_rename(const char *, const char *);
 int   			   newfs_utimens(const char *, const struct timespec tv[2]);
 int   			   newfs_truncate(const char *, off_t);
+int   			   newfs_fallocate(const char *, int, off_t, off_t,
+						                struct fuse_file_info *);
+ssize_t			   newfs_copy_file_range(const char *, struct fuse_file_info *, off_t,
+						                const char *, struct fuse_file_info *, off_t,
+						                size_t, int);
+int   			   newfs_setxattr(const char *, const char *, const char *, size_t, int);
+int   			   newfs_getxattr(const char *, const char *, char *, size_t);
+int   			   newfs_listxattr(const char *, char *, size_t);
+int   			   newfs_removexattr(const char *, const char *);
 			
 int   			   newfs_open(const char *, struct fuse_file_info *);
 int   			   newfs_opendir(const char *, struct fuse_file_info *);
 
+/******************************************************************************
+* SECTION: crc32c.c
+*******************************************************************************/
+void               newfs_crc32c_init(void);
+uint32_t           newfs_crc32c(const uint8_t *, size_t);
+
+/******************************************************************************
+* SECTION: stats.c
+*******************************************************************************/
+struct newfs_stats* newfs_stats_local(void);
+uint64_t           newfs_stats_now(void);
+void               newfs_stats_op(int, uint64_t);
+int                newfs_stats_render(char *, int);
+char*              newfs_stats_text(int *);
+int   			   newfs_timed_getattr(const char *, struct stat *);
+int   			   newfs_timed_read(const char *, char *, size_t, off_t,
+					                       struct fuse_file_info *);
+int   			   newfs_timed_write(const char *, const char *, size_t, off_t,
+					                        struct fuse_file_info *);
+int   			   newfs_timed_readdir(const char *, void *, fuse_fill_dir_t, off_t,
+						                      struct fuse_file_info *);
+int   			   newfs_timed_mknod(const char *, mode_t, dev_t);
+
+/******************************************************************************
+* SECTION: compress.c
+*******************************************************************************/
+int                newfs_compress(const uint8_t *, int, uint8_t *, int);
+int                newfs_decompress(const uint8_t *, int, uint8_t *, int);
+
+/******************************************************************************
+* SECTION: layout.c
+*******************************************************************************/
+int                newfs_layout_grow(struct newfs_super_d *, long);
+
+/******************************************************************************
+* SECTION: log.c
+*******************************************************************************/
+extern int         newfs_log_level;
+void               newfs_log_write(int, const char *, ...) __attribute__((format(printf, 2, 3)));
+int                newfs_log_start(const char *, int);
+void               newfs_log_stop_drain(void);
+
 #endif  /* _newfs_H_ */
\ No newline at end of file
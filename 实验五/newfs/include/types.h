@@ -1,26 +1,53 @@
 
 #include <stdbool.h>
+#include <pthread.h>
 #ifndef _TYPES_H_
 #define _TYPES_H_
 #define UINT8_BITS               8
 
-#define NEWFS_MAGIC_NUM           0x20011005
+#define NEWFS_MAGIC_NUM           0x20011006  // 布局变化时递增：校验和表、inode引用计数表、128字节inode(内联xattr)
+#define NEWFS_MAGIC_NUM_V1        0x20011005  // 最初布局的幻数，其镜像不能按当前布局解析，也不能当作空盘格式化
 #define NEWFS_MAX_FILE_NAME       128
 #define NEWFS_SUPER_BLOCKS        1       // super超级块包含的逻辑块数量
 #define NEWFS_MAP_INODE_BLOCKS    1       // inode位图包含的逻辑块数量
 #define NEWFS_MAP_DATA_BLOCKS     1       // data位图包含的逻辑块数量
+#define NEWFS_MAP_REF_BLOCKS      4       // 数据块引用计数表包含的逻辑块数量 每个数据块1字节
+#define NEWFS_MAP_CSUM_BLOCKS     16      // 数据块校验和表包含的逻辑块数量 每个数据块4字节CRC32C
+#define NEWFS_MAP_IREF_BLOCKS     4       // inode引用计数表包含的逻辑块数量 每个inode1字节
 #define NEWFS_INODE_PER_FILE      1       // 每个inode最多对应的file文件数量
 #define NEWFS_DATA_PER_FILE       8       // 每个file文件最多包含的数据块数量
 #define NEWFS_BLOCK_SIZE          1024    // 逻辑块大小
 #define NEWFS_SUPER_OFS           0       // 超级块起始位置
 #define NEWFS_MAP_INODE_OFS       1024    // inode位图起始位置 0 + 1024   
 #define NEWFS_MAP_DATA_OFS        2048    // data位图起始位置 1024 + 1 * 1024 
-#define NEWFS_INODE_OFS           3072    // inode起始位置 2048 + 1 * 1024  
-#define NEWFS_INODE_SIZE          32      // 每个inode的大小 每个块存1024 / 32 = 32个INODE 一共需要NEW_ROUND_UP(3968 * 32, 1024) / 1024 = 124块存取INODE
-#define NEWFS_INODE_NUM           3968    // inode数量 ((4096 - 1 - 1 - 1) * 1024 / (1024 + 32) = 3968
-#define NEWFS_DATA_OFS            130048  // data起始位置 3072 + 124 * 1024
+#define NEWFS_MAP_REF_OFS         3072    // 引用计数表起始位置 2048 + 1 * 1024
+#define NEWFS_MAP_CSUM_OFS        7168    // 校验和表起始位置 3072 + 4 * 1024
+#define NEWFS_MAP_IREF_OFS        23552   // inode引用计数表起始位置 7168 + 16 * 1024
+#define NEWFS_INODE_OFS           27648   // inode起始位置 23552 + 4 * 1024
+#define NEWFS_INODE_SIZE          128     // 每个inode的大小(含内联xattr区) 每个块存1024 / 128 = 8个INODE 一共需要NEW_ROUND_UP(3968 * 128, 1024) / 1024 = 496块存取INODE
+#define NEWFS_INODE_NUM           3968    // inode数量
+#define NEWFS_DATA_OFS            535552  // data起始位置 27648 + 496 * 1024
 #define NEWFS_DATA_SIZE           1024    // 每个数据块大小
-#define NEWFS_DATA_NUM            3968    // 数据块数量 3968
+#define NEWFS_DATA_NUM            3573    // 数据块数量 4096 - 1 - 1 - 1 - 4 - 16 - 4 - 496 = 3573
+#define NEWFS_REF_MAX             255     // 单个数据块的最大额外引用数
+#define NEWFS_DIR_HASH_SZ         16      // 每个目录的dentry哈希桶数量
+#define NEWFS_SCRUB_RATE          64      // 后台校验默认速率，每秒校验的数据块数
+#define NEWFS_DEDUP_BUCKETS       1024    // 去重指纹索引的哈希桶数量
+#define NEWFS_XATTR_INLINE_SZ     64      // inode记录中内联xattr区大小，放不下的xattr存入专用数据块
+#define NEWFS_XATTR_NAME_MAX      255     // xattr名最大长度
+#define NEWFS_STATS_BUCKETS       40      // 延迟直方图桶数，第i桶为(2^(i-1), 2^i]纳秒
+#define NEWFS_STATS_PATH          "/.newfs_stats" // 只读的虚拟统计文件
+#define NEWFS_STATS_TEXT_SZ       8192    // 统计文件内容的最大长度，超出部分截断
+#define NEWFS_INODE_COMPRESSED    0x1     // inode标志：数据以压缩形式存放在block_pointer的前若干块
+#define NEWFS_IREF_MAX            255     // 单个inode的最大额外引用数（被多个快照共享）
+#define NEWFS_SNAP_MAX            16      // 快照数量上限，快照表存放在超级块中
+#define NEWFS_SNAP_NAME           32      // 快照名最大长度（含'\0'）
+#define NEWFS_SNAP_PATH           "/.snapshots" // 虚拟快照目录，mkdir/rmdir其下的名字即创建/删除快照
+#define NEWFS_GROW_XATTR          "user.newfs.grow" // 对根目录设置该属性（值为新的磁盘字节数）即在线扩容
+#define NEWFS_CLONE_XATTR         "user.newfs.clone" // 对文件设置该属性（值为挂载点内的源文件路径）即整体克隆源文件
+#define NEWFS_LOG_RING_SZ         1024    // 日志环形缓冲区槽数，须为2的幂
+#define NEWFS_LOG_MSG_SZ          240     // 单条日志最大长度，超出截断
+#define NEWFS_LOG_DRAIN_US        10000   // 日志线程空闲时的休眠间隔
 
 #define NEWFS_ERROR_NONE          0
 #define NEWFS_ERROR_ACCESS        EACCES
@@ -32,18 +59,30 @@
 #define NEWFS_ERROR_UNSUPPORTED   ENXIO
 #define NEWFS_ERROR_IO            EIO     /* Error Input/Output */
 #define NEWFS_ERROR_INVAL         EINVAL  /* Invalid Args */
+#define NEWFS_ERROR_NOTEMPTY      ENOTEMPTY
+#define NEWFS_ERROR_NOTDIR        ENOTDIR
+#define NEWFS_ERROR_FBIG          EFBIG
+#define NEWFS_ERROR_OPNOTSUPP     EOPNOTSUPP
+#define NEWFS_ERROR_NODATA        ENODATA  /* xattr不存在 */
+#define NEWFS_ERROR_RANGE         ERANGE
+#define NEWFS_ERROR_2BIG          E2BIG
+#define NEWFS_ERROR_ROFS          EROFS    /* 以只读方式挂载的快照 */
 
 #define NEWFS_IOBLOCK_SZ()              (newfs_super.sz_io) // IO块大小
 #define NEWFS_DISK_SZ()                 (newfs_super.sz_disk) // 磁盘容量大小
 #define NEWFS_DRIVER()                  (newfs_super.driver_fd) // 磁盘号
 
-#define NEWFS_ROUND_DOWN(value, round)    (value % round == 0 ? value : (value / round) * round) // 向下取整计算对应的逻辑块号
-#define NEWFS_ROUND_UP(value, round)      (value % round == 0 ? value : (value / round + 1) * round) // 向上取整计算对应的逻辑块号
+#define NEWFS_ROUND_DOWN(value, round)    ((value) % (round) == 0 ? (value) : ((value) / (round)) * (round)) // 向下取整计算对应的逻辑块号
+#define NEWFS_ROUND_UP(value, round)      ((value) % (round) == 0 ? (value) : ((value) / (round) + 1) * (round)) // 向上取整计算对应的逻辑块号
 #define NEWFS_ASSIGN_FNAME(pnewfs_dentry, _fname)\
                                         memcpy(pnewfs_dentry->fname, _fname, strlen(_fname)) 
 #define NEWFS_BLKS_SZ()                 (NEWFS_ROUND_UP(NEWFS_BLOCK_SIZE, NEWFS_IOBLOCK_SZ())) // 逻辑块大小                      
-#define NEWFS_INO_OFS(ino)              (NEWFS_INODE_OFS + ino * NEWFS_INODE_SIZE) // 对应的inode位置
-#define NEWFS_DA_OFS(data)              (NEWFS_DATA_OFS + data * NEWFS_DATA_PER_FILE * NEWFS_DATA_SIZE) // 对应的data位置
+#define NEWFS_INO_OFS(ino)              (newfs_super.inode_offset + (ino) * NEWFS_INODE_SIZE) // 对应的inode位置，布局取自超级块
+#define NEWFS_DA_OFS(blk)               (newfs_super.data_offset + (blk) * NEWFS_DATA_SIZE) // 对应的数据块位置
+#define NEWFS_DA_BLK(ofs)               (((ofs) - newfs_super.data_offset) / NEWFS_DATA_SIZE) // 磁盘偏移对应的数据块号
+#define NEWFS_DA_END()                  (NEWFS_DA_OFS(newfs_super.max_data)) // 数据区结束位置，扩容后其后可能是迁移来的表
+#define NEWFS_DENTRY_PER_BLK()          (NEWFS_DATA_SIZE / sizeof(struct newfs_dentry_d)) // 每个数据块存放的dentry数量
+#define NEWFS_FILE_MAX_SZ()             (NEWFS_DATA_PER_FILE * NEWFS_BLKS_SZ()) // 单个文件最大大小
 #define NEWFS_IS_DIR(pinode)            (pinode->dentry->ftype == NEWFS_DIR) // 是否是dir文件
 #define NEWFS_IS_REG(pinode)            (pinode->dentry->ftype == NEWFS_FILE) // 是否是file文件
 #define NEWFS_IS_SYM_LINK(pinode)       (pinode->dentry->ftype == NEWFS_SYM_LINK) // 是否是symlink文件
@@ -52,7 +91,22 @@ struct newfs_dentry;
 struct newfs_inode;
 struct newfs_super;
 
-#define NEWFS_DBG(fmt, ...) do { printf("NEWFS_DBG: " fmt, ##__VA_ARGS__); } while(0) 
+#define NEWFS_LOG_ERR             0
+#define NEWFS_LOG_WARN            1
+#define NEWFS_LOG_INFO            2
+#define NEWFS_LOG_DEBUG           3
+#ifndef NEWFS_LOG_COMPILE_LEVEL
+#define NEWFS_LOG_COMPILE_LEVEL   NEWFS_LOG_INFO  // 高于该级别的日志在编译期消除
+#endif
+#define NEWFS_LOG(level, fmt, ...)      do { if ((level) <= NEWFS_LOG_COMPILE_LEVEL && (level) <= newfs_log_level) \
+                                                 newfs_log_write(level, fmt, ##__VA_ARGS__); } while(0) // 先做编译期、运行期级别检查，未通过时不求值参数
+#define NEWFS_ERR(fmt, ...)             NEWFS_LOG(NEWFS_LOG_ERR, fmt, ##__VA_ARGS__)
+#define NEWFS_WARN(fmt, ...)            NEWFS_LOG(NEWFS_LOG_WARN, fmt, ##__VA_ARGS__)
+#define NEWFS_INFO(fmt, ...)            NEWFS_LOG(NEWFS_LOG_INFO, fmt, ##__VA_ARGS__)
+#define NEWFS_DBG(fmt, ...)             NEWFS_LOG(NEWFS_LOG_DEBUG, fmt, ##__VA_ARGS__)
+#define NEWFS_STAT_ADD(field, v)        __atomic_store_n(&(field), (field) + (v), __ATOMIC_RELAXED) // 仅本线程写，无需原子读改写
+#define NEWFS_STAT(field, v)            do { struct newfs_stats* _stats = newfs_stats_local(); \
+                                             NEWFS_STAT_ADD(_stats->field, v); } while(0) // 当前线程计数器加v
 
 typedef enum file_type {
     NEWFS_FILE,           // 普通文件
@@ -60,8 +114,45 @@ typedef enum file_type {
     NEWFS_SYM_LINK        // 链接文件
 } NEWFS_FILE_TYPE;
 
+typedef enum newfs_op {
+    NEWFS_OP_GETATTR,
+    NEWFS_OP_LOOKUP,
+    NEWFS_OP_READ,
+    NEWFS_OP_WRITE,
+    NEWFS_OP_READDIR,
+    NEWFS_OP_MKNOD,
+    NEWFS_OP_SYNC,
+    NEWFS_OP_NUM
+} NEWFS_OP;
+
+struct newfs_stats {    // 单个线程的计数器，next之前均为uint64_t，汇总时按数组逐项累加
+    uint64_t            op_cnt[NEWFS_OP_NUM];       // 操作次数
+    uint64_t            op_ns[NEWFS_OP_NUM];        // 累计耗时
+    uint64_t            op_hist[NEWFS_OP_NUM][NEWFS_STATS_BUCKETS]; // log2(纳秒)延迟直方图
+    uint64_t            dev_rd_ios;                 // 驱动读次数
+    uint64_t            dev_rd_bytes;
+    uint64_t            dev_wr_ios;                 // 驱动写次数
+    uint64_t            dev_wr_bytes;
+    uint64_t            icache_hit;                 // 查找路径时inode已在内存
+    uint64_t            icache_miss;                // 需从磁盘读入inode
+    uint64_t            xattr_hit;                  // xattr在内联区命中
+    uint64_t            xattr_miss;                 // xattr需查找xattr块
+    struct newfs_stats* next;
+};
+
 struct custom_options {
 	const char*        device;
+	int                scrub_rate;                  // 后台校验速率（块/秒），0关闭
+	int                compress;                    // 刷盘时压缩文件数据
+	int                dedup;                       // 刷盘时对数据块去重
+	int                log_level;                   // 运行时日志级别NEWFS_LOG_*
+	const char*        log_file;                    // 日志文件，缺省为stderr
+	const char*        snapshot;                    // 只读挂载该快照，NULL挂载当前文件系统
+};
+
+struct newfs_snap_d {   // 快照：根inode为当前根目录在创建时刻的副本
+    char                name[NEWFS_SNAP_NAME];
+    int                 ino;                        // 快照根inode号，0表示空槽
 };
 
 struct newfs_super_d { 
@@ -97,19 +188,36 @@ struct newfs_super_d {
 
     int                 map_data_blks;              // data位图占用的块数
     int                 map_data_offset;            // data位图在磁盘上的偏移
+    int                 map_ref_blks;               // 引用计数表占用的块数
+    int                 map_ref_offset;             // 引用计数表在磁盘上的偏移
+    int                 map_csum_blks;              // 校验和表占用的块数
+    int                 map_csum_offset;            // 校验和表在磁盘上的偏移
+    int                 map_iref_blks;              // inode引用计数表占用的块数
+    int                 map_iref_offset;            // inode引用计数表在磁盘上的偏移
     int                 inode_offset;               // inode在磁盘上的偏移
     int                 data_offset;                // data在磁盘上的偏移
 
     int                 sz_usage;
+    struct newfs_snap_d snaps[NEWFS_SNAP_MAX];      // 快照表
 };
 
-struct newfs_inode_d {  // 32B
+struct newfs_inode_d {  // 128B
     int                 ino;                        // 在inode位图中的下标
     int                 size;                       // 文件已占用空间
     int                 link;                       // 链接数
     NEWFS_FILE_TYPE     ftype;                      // 文件类型（目录类型、普通文件类型）
     int                 dir_cnt;                    // 如果是目录类型文件，下面有几个目录项
-    uint8_t*            data;                    // 数据块指针（可固定分配）
+    int                 block_pointer[NEWFS_DATA_PER_FILE]; // 数据块号，-1表示未分配
+    int                 flags;                      // NEWFS_INODE_COMPRESSED等
+    int                 csize;                      // 压缩后的数据长度
+    int                 xattr_blk;                  // 存放xattr的数据块号，-1表示没有
+    uint8_t             xattr_inline[NEWFS_XATTR_INLINE_SZ]; // 内联xattr区
+};
+
+struct newfs_xattr_d {  // xattr条目头，后跟name（不含'\0'）与value；name_len为0表示结束
+    uint8_t             name_len;
+    uint8_t             rsv;
+    uint16_t            value_len;
 };
 
 struct newfs_dentry_d { // 
@@ -119,6 +227,13 @@ struct newfs_dentry_d { //
     int                 valid;                      // 该目录项是否有效
 };
 
+struct newfs_dedup_node {                           // 指纹索引中的一个数据块
+    int                 prev;
+    int                 next;
+    uint32_t            fp;                         // 入索引时的指纹（CRC32C）
+    bool                linked;
+};
+
 struct newfs_super {   
 
     int                 sz_io;
@@ -135,6 +250,26 @@ struct newfs_super {
     uint8_t*            map_data;                   // data位图
     int                 map_data_blks;
     int                 map_data_offset;
+    uint8_t*            map_ref;                    // 数据块额外引用数，0表示仅被一个文件使用
+    int                 map_ref_blks;
+    int                 map_ref_offset;
+    uint32_t*           map_csum;                   // 数据块CRC32C
+    int                 map_csum_blks;
+    int                 map_csum_offset;
+    uint8_t*            map_unwritten;              // 已分配、尚未写过的数据块，校验和无效；只在内存中，大小同data位图
+    uint8_t*            map_iref;                   // inode额外引用数，快照与当前树共享inode时大于0
+    int                 map_iref_blks;
+    int                 map_iref_offset;
+    struct newfs_snap_d snaps[NEWFS_SNAP_MAX];
+    bool                read_only;                  // 挂载的是快照
+    int                 csum_errors;                // 校验失败次数
+    int*                dedup_head;                 // 指纹哈希桶，按块号串成双向链表
+    struct newfs_dedup_node*dedup_nodes;            // 每个数据块一个节点
+    int                 dedup_hits;                 // 刷盘时去重省下的块写次数
+
+    pthread_mutex_t     driver_lock;                // 串行化磁盘seek+读写
+    pthread_t           scrub_thread;               // 后台校验线程
+    volatile bool       scrub_stop;
     int                 inode_offset;               // inode在磁盘上的偏移
     int                 data_offset;                // data在磁盘上的偏移
     bool                is_mounted;
@@ -148,7 +283,17 @@ struct newfs_inode {
     int                 dir_cnt;                    // 目录项数量
     struct newfs_dentry*dentry;                     // 指向该inode的dentry
     struct newfs_dentry*dentrys;                    // 所有目录项  
+    struct newfs_dentry**dentry_hash;               // 目录项哈希表，仅目录使用
+    int                 block_pointer[NEWFS_DATA_PER_FILE]; // 数据块号，-1表示未分配
     uint8_t*            data;                    // 数据块指针
+    int                 flags;                      // 置NEWFS_INODE_COMPRESSED时磁盘上为压缩数据，修改前需先解压布局
+    int                 csize;                      // 压缩后的数据长度
+    uint32_t            dirty;                      // 第i位为1表示第i个逻辑块的内存内容尚未写回
+    int                 xattr_blk;                  // 存放xattr的数据块号，-1表示没有
+    uint8_t             xattr_inline[NEWFS_XATTR_INLINE_SZ]; // 内联xattr区，随inode记录读写
+    uint8_t*            xattr_buf;                  // xattr块内容，首次访问时读入
+    bool                xattr_dirty;                // xattr块需要写回
+    bool                is_corrupt;                 // 数据块校验失败，拒绝读写且不刷回
 };
 
 struct newfs_dentry {   
@@ -156,6 +301,8 @@ struct newfs_dentry {
     NEWFS_FILE_TYPE    ftype;                       // 指向的inode文件类型
     struct newfs_dentry*parent;                     /* 父亲Inode的dentry */
     struct newfs_dentry*brother;                    /* 兄弟 */
+    struct newfs_dentry*prev_brother;               /* 前一个兄弟，O(1)摘除 */
+    struct newfs_dentry*hash_next;                  /* 哈希桶链表 */
     int                ino;                         // 指向的inode号
     struct newfs_inode*inode;                       /* 指向inode */
     int                valid;                       // 该目录项是否有效
@@ -0,0 +1,167 @@
+#include "newfs.h"
+
+/******************************************************************************
+* SECTION: LZ4块格式压缩
+*
+* 每个序列: token(高4位字面量长度, 低4位匹配长度-4) | 字面量 | 2字节偏移 | 匹配长度扩展
+* 长度字段为15时后跟若干字节累加（255表示继续）。最后一个序列只有字面量。
+*******************************************************************************/
+#define LZ_MIN_MATCH        4
+#define LZ_LAST_LITERALS    5               /* 末尾至少保留的字面量 */
+#define LZ_MF_LIMIT         12              /* 距结尾不足该长度时不再找匹配 */
+#define LZ_HASH_BITS        12
+#define LZ_MAX_OFFSET       65535
+
+static inline uint32_t lz_read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v) {
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t* lz_put_len(uint8_t* op, uint8_t* oend, int len) {
+    while (len >= 255 && op < oend) {
+        *op++ = 255;
+        len  -= 255;
+    }
+    if (op < oend) {
+        *op++ = (uint8_t)len;
+    }
+    return op;
+}
+
+/**
+ * @brief 压缩
+ *
+ * @param src 原始数据
+ * @param src_len 原始长度
+ * @param dst 输出缓冲区
+ * @param dst_cap 输出缓冲区容量
+ * @return int 压缩后长度，放不下（不可压缩）时返回-1
+ */
+int newfs_compress(const uint8_t* src, int src_len, uint8_t* dst, int dst_cap) {
+    int            table[1 << LZ_HASH_BITS];
+    const uint8_t* ip       = src;
+    const uint8_t* anchor   = src;
+    const uint8_t* iend     = src + src_len;
+    const uint8_t* mflimit  = iend - LZ_MF_LIMIT;
+    const uint8_t* mlimit   = iend - LZ_LAST_LITERALS;
+    uint8_t*       op       = dst;
+    uint8_t*       oend     = dst + dst_cap;
+    uint8_t*       token;
+    int            lit_len, match_len, ref;
+
+    memset(table, -1, sizeof(table));
+    while (src_len >= LZ_MF_LIMIT && ip < mflimit) {
+        uint32_t h = lz_hash(lz_read32(ip));
+        ref        = table[h];
+        table[h]   = ip - src;
+        if (ref < 0 || ip - (src + ref) > LZ_MAX_OFFSET || lz_read32(src + ref) != lz_read32(ip)) {
+            ip++;
+            continue;
+        }
+        match_len = LZ_MIN_MATCH;                     /* 向后扩展匹配 */
+        while (ip + match_len < mlimit && src[ref + match_len] == ip[match_len]) {
+            match_len++;
+        }
+        lit_len = ip - anchor;
+        if (op + 1 + lit_len + lit_len / 255 + 2 + match_len / 255 + 1 > oend) {
+            return -1;
+        }
+        token = op++;
+        *token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+        if (lit_len >= 15) {
+            op = lz_put_len(op, oend, lit_len - 15);
+        }
+        memcpy(op, anchor, lit_len);
+        op += lit_len;
+        *op++ = (uint8_t)((ip - (src + ref)) & 0xFF);
+        *op++ = (uint8_t)((ip - (src + ref)) >> 8);
+        *token |= (uint8_t)(match_len - LZ_MIN_MATCH >= 15 ? 15 : match_len - LZ_MIN_MATCH);
+        if (match_len - LZ_MIN_MATCH >= 15) {
+            op = lz_put_len(op, oend, match_len - LZ_MIN_MATCH - 15);
+        }
+        ip    += match_len;
+        anchor = ip;
+    }
+                                                      /* 最后一个序列：剩余字面量 */
+    lit_len = iend - anchor;
+    if (op + 1 + lit_len + lit_len / 255 + 1 > oend) {
+        return -1;
+    }
+    token  = op++;
+    *token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15) {
+        op = lz_put_len(op, oend, lit_len - 15);
+    }
+    memcpy(op, anchor, lit_len);
+    op += lit_len;
+    return op - dst;
+}
+
+/**
+ * @brief 解压，对输入做边界检查，损坏的数据不会越界
+ *
+ * @param src 压缩数据
+ * @param src_len 压缩长度
+ * @param dst 输出缓冲区
+ * @param dst_len 期望的原始长度
+ * @return int 解压出的长度，数据损坏返回-1
+ */
+int newfs_decompress(const uint8_t* src, int src_len, uint8_t* dst, int dst_len) {
+    const uint8_t* ip   = src;
+    const uint8_t* iend = src + src_len;
+    uint8_t*       op   = dst;
+    uint8_t*       oend = dst + dst_len;
+    int            len, offset;
+    uint8_t        token, b;
+
+    while (ip < iend) {
+        token = *ip++;
+        len   = token >> 4;
+        if (len == 15) {
+            do {
+                if (ip >= iend) return -1;
+                b    = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        if (len > iend - ip || len > oend - op) {
+            return -1;
+        }
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+        if (ip == iend) {                             /* 最后一个序列没有匹配部分 */
+            break;
+        }
+        if (iend - ip < 2) {
+            return -1;
+        }
+        offset = ip[0] | (ip[1] << 8);
+        ip    += 2;
+        if (offset == 0 || offset > op - dst) {
+            return -1;
+        }
+        len = token & 0x0F;
+        if (len == 15) {
+            do {
+                if (ip >= iend) return -1;
+                b    = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        len += LZ_MIN_MATCH;
+        if (len > oend - op) {
+            return -1;
+        }
+        while (len--) {                               /* 允许重叠复制 */
+            *op = *(op - offset);
+            op++;
+        }
+    }
+    return op - dst;
+}
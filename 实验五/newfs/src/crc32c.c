@@ -0,0 +1,109 @@
+#include "newfs.h"
+
+/******************************************************************************
+* SECTION: CRC32C (Castagnoli)
+*******************************************************************************/
+#define CRC32C_POLY         0x82F63B78      /* 反射多项式 */
+
+static uint32_t crc32c_table[8][256];       /* slice-by-8查表 */
+static bool     crc32c_has_hw = false;
+
+/**
+ * @brief 软件实现，一次处理8字节
+ *
+ * @param crc
+ * @param buf
+ * @param len
+ * @return uint32_t
+ */
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t* buf, size_t len) {
+    while (len && ((uintptr_t)buf & 7)) {
+        crc = crc32c_table[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, buf, 8);
+        word ^= crc;
+        crc = crc32c_table[7][ word        & 0xFF] ^ crc32c_table[6][(word >> 8)  & 0xFF] ^
+              crc32c_table[5][(word >> 16) & 0xFF] ^ crc32c_table[4][(word >> 24) & 0xFF] ^
+              crc32c_table[3][(word >> 32) & 0xFF] ^ crc32c_table[2][(word >> 40) & 0xFF] ^
+              crc32c_table[1][(word >> 48) & 0xFF] ^ crc32c_table[0][ word >> 56];
+        buf += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = crc32c_table[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+/**
+ * @brief SSE4.2 crc32指令实现，运行时检测到CPU支持时使用
+ *
+ * @param crc
+ * @param buf
+ * @param len
+ * @return uint32_t
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t* buf, size_t len) {
+    uint64_t crc64 = crc;
+    while (len && ((uintptr_t)buf & 7)) {
+        crc64 = __builtin_ia32_crc32qi((uint32_t)crc64, *buf++);
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, buf, 8);
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+        buf += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc64 = __builtin_ia32_crc32qi((uint32_t)crc64, *buf++);
+    }
+    return (uint32_t)crc64;
+}
+#endif
+
+/**
+ * @brief 初始化查表并检测硬件支持，挂载时调用一次
+ */
+void newfs_crc32c_init(void) {
+    uint32_t crc;
+    for (int i = 0; i < 256; i++) {
+        crc = i;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0 - (crc & 1)));
+        }
+        crc32c_table[0][i] = crc;
+    }
+    for (int i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            crc32c_table[k][i] = crc32c_table[0][crc32c_table[k - 1][i] & 0xFF] ^
+                                 (crc32c_table[k - 1][i] >> 8);
+        }
+    }
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    crc32c_has_hw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+/**
+ * @brief 计算一段数据的CRC32C
+ *
+ * @param buf
+ * @param len
+ * @return uint32_t
+ */
+uint32_t newfs_crc32c(const uint8_t* buf, size_t len) {
+#if defined(__x86_64__)
+    if (crc32c_has_hw) {
+        return ~crc32c_hw(~0U, buf, len);
+    }
+#endif
+    return ~crc32c_sw(~0U, buf, len);
+}
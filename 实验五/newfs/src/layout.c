@@ -0,0 +1,68 @@
+#include "newfs.h"
+
+/******************************************************************************
+* SECTION: 扩容布局
+*
+* 只计算新布局，不做IO，newfs在线扩容与grow.newfs离线扩容共用。
+* 数据区位于inode表之后，扩容时直接向后延伸；按数据块索引的三张表
+* （data位图、引用计数表、校验和表）容量不足时整体迁到磁盘末尾，
+* 再次扩容时随末尾继续后移，迁移的只是表本身，数据块原地不动。
+*******************************************************************************/
+#define NEWFS_LAYOUT_BLKS(bytes)  (NEWFS_ROUND_UP((bytes), NEWFS_BLOCK_SIZE) / NEWFS_BLOCK_SIZE)
+
+/**
+ * @brief 容纳data_num个数据块的三张表共占多少块
+ *
+ * @param data_num
+ * @return long
+ */
+static long newfs_layout_map_blks(long data_num) {
+    return NEWFS_LAYOUT_BLKS(NEWFS_ROUND_UP(data_num, UINT8_BITS) / UINT8_BITS) +
+           NEWFS_LAYOUT_BLKS(data_num) +
+           NEWFS_LAYOUT_BLKS(data_num * sizeof(uint32_t));
+}
+
+/**
+ * @brief 计算把磁盘扩展到sz_disk字节后的布局，成功时改写super中的max_data与三张表的位置和大小
+ *
+ * @param super 当前布局
+ * @param sz_disk 新的磁盘大小
+ * @return int 0成功；新大小放不下更多数据块时返回-NEWFS_ERROR_INVAL
+ */
+int newfs_layout_grow(struct newfs_super_d* super, long sz_disk) {
+    long data_start = super->data_offset / NEWFS_BLOCK_SIZE;
+    long total      = sz_disk / NEWFS_BLOCK_SIZE;
+    long data_num   = total - data_start;
+    long over;
+    bool at_tail    = super->map_data_offset > super->data_offset;
+    long cap        = (long)super->map_data_blks * NEWFS_BLOCK_SIZE * UINT8_BITS;
+
+    if (cap > (long)super->map_ref_blks * NEWFS_BLOCK_SIZE) {
+        cap = (long)super->map_ref_blks * NEWFS_BLOCK_SIZE;
+    }
+    if (cap > (long)super->map_csum_blks * NEWFS_BLOCK_SIZE / (long)sizeof(uint32_t)) {
+        cap = (long)super->map_csum_blks * NEWFS_BLOCK_SIZE / (long)sizeof(uint32_t);
+    }
+    if (!at_tail && data_num <= cap) {                /* 原位置的表还放得下，只延长数据区 */
+        if (data_num <= super->max_data) {
+            return -NEWFS_ERROR_INVAL;
+        }
+        super->max_data = (int)data_num;
+        return NEWFS_ERROR_NONE;
+    }
+
+    while ((over = data_num + newfs_layout_map_blks(data_num) - (total - data_start)) > 0) {
+        data_num -= over;                             /* 每轮至少少一块，表随之缩小，很快收敛 */
+    }
+    if (data_num <= super->max_data) {
+        return -NEWFS_ERROR_INVAL;
+    }
+    super->max_data        = (int)data_num;
+    super->map_data_blks   = NEWFS_LAYOUT_BLKS(NEWFS_ROUND_UP(data_num, UINT8_BITS) / UINT8_BITS);
+    super->map_ref_blks    = NEWFS_LAYOUT_BLKS(data_num);
+    super->map_csum_blks   = NEWFS_LAYOUT_BLKS(data_num * sizeof(uint32_t));
+    super->map_data_offset = (int)((data_start + data_num) * NEWFS_BLOCK_SIZE);
+    super->map_ref_offset  = super->map_data_offset + super->map_data_blks * NEWFS_BLOCK_SIZE;
+    super->map_csum_offset = super->map_ref_offset + super->map_ref_blks * NEWFS_BLOCK_SIZE;
+    return NEWFS_ERROR_NONE;
+}
@@ -0,0 +1,153 @@
+#include "newfs.h"
+#include <stdarg.h>
+
+/******************************************************************************
+* SECTION: 分级日志
+*
+* 生产者（任意FUSE线程）在有界环形缓冲区中以CAS占槽、格式化后以序号发布，
+* 全程无锁；后台线程按序取出写入日志文件。缓冲区满时丢弃新日志并计数，
+* 不会阻塞前台请求。
+*******************************************************************************/
+struct newfs_log_slot {
+    volatile uint64_t   seq;                        /* 等于pos表示空闲，pos + 1表示已发布 */
+    int                 level;
+    char                msg[NEWFS_LOG_MSG_SZ];
+};
+
+static const char*           newfs_log_names[]  = { "ERR", "WARN", "INFO", "DBG" };
+static struct newfs_log_slot newfs_log_ring[NEWFS_LOG_RING_SZ];
+static uint64_t              newfs_log_head     = 0;     /* 下一个待占用的位置 */
+static uint64_t              newfs_log_tail     = 0;     /* 下一个待写出的位置，仅后台线程使用 */
+static uint64_t              newfs_log_dropped  = 0;
+static FILE*                 newfs_log_fp       = NULL;
+static pthread_t             newfs_log_thread;
+static volatile bool         newfs_log_stop     = false;
+static bool                  newfs_log_running  = false;
+int                          newfs_log_level    = NEWFS_LOG_WARN;
+
+/**
+ * @brief 静态初始化各槽序号，保证在newfs_log_start之前的日志也能入队
+ */
+__attribute__((constructor))
+static void newfs_log_ring_init(void) {
+    for (uint64_t pos = 0; pos < NEWFS_LOG_RING_SZ; pos++) {
+        newfs_log_ring[pos].seq = pos;
+    }
+}
+
+/**
+ * @brief 写一条日志到环形缓冲区，由NEWFS_LOG系列宏在级别检查通过后调用
+ *
+ * @param level NEWFS_LOG_*
+ * @param fmt
+ * @param ...
+ */
+void newfs_log_write(int level, const char* fmt, ...) {
+    struct newfs_log_slot* slot;
+    uint64_t pos = __atomic_load_n(&newfs_log_head, __ATOMIC_RELAXED);
+    int64_t  diff;
+    va_list  args;
+
+    for (;;) {
+        slot = &newfs_log_ring[pos % NEWFS_LOG_RING_SZ];
+        diff = (int64_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&newfs_log_head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }                                         /* 失败时pos已更新为最新head */
+        }
+        else if (diff < 0) {                          /* 已满 */
+            __atomic_fetch_add(&newfs_log_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else {
+            pos = __atomic_load_n(&newfs_log_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->level = level;
+    va_start(args, fmt);
+    vsnprintf(slot->msg, NEWFS_LOG_MSG_SZ, fmt, args);
+    va_end(args);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 写出所有已发布的日志
+ *
+ * @return int 写出的条数
+ */
+static int newfs_log_drain(void) {
+    struct newfs_log_slot* slot;
+    uint64_t dropped;
+    int      cnt = 0;
+    for (;;) {
+        slot = &newfs_log_ring[newfs_log_tail % NEWFS_LOG_RING_SZ];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != newfs_log_tail + 1) {
+            break;
+        }
+        fprintf(newfs_log_fp, "NEWFS_%s: %s", newfs_log_names[slot->level], slot->msg);
+        __atomic_store_n(&slot->seq, newfs_log_tail + NEWFS_LOG_RING_SZ, __ATOMIC_RELEASE);
+        newfs_log_tail++;
+        cnt++;
+    }
+    dropped = __atomic_exchange_n(&newfs_log_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped != 0) {
+        fprintf(newfs_log_fp, "NEWFS_WARN: %lu log messages dropped\n", dropped);
+    }
+    if (cnt != 0 || dropped != 0) {
+        fflush(newfs_log_fp);
+    }
+    return cnt;
+}
+
+/**
+ * @brief 后台写日志线程，缓冲区空时短暂休眠
+ *
+ * @param arg
+ * @return void*
+ */
+static void* newfs_log_worker(void* arg) {
+    while (!newfs_log_stop) {
+        if (newfs_log_drain() == 0) {
+            usleep(NEWFS_LOG_DRAIN_US);
+        }
+    }
+    newfs_log_drain();
+    return NULL;
+}
+
+/**
+ * @brief 打开日志文件并启动后台线程
+ *
+ * @param path 日志文件路径，NULL时写到stderr
+ * @param level 运行时日志级别，高于该级别的日志不入队
+ * @return int 0成功，否则-NEWFS_ERROR_IO
+ */
+int newfs_log_start(const char* path, int level) {
+    newfs_log_level = level;
+    newfs_log_fp    = path != NULL ? fopen(path, "a") : stderr;
+    if (newfs_log_fp == NULL) {
+        newfs_log_fp = stderr;
+        return -NEWFS_ERROR_IO;
+    }
+    newfs_log_stop    = false;
+    newfs_log_running = pthread_create(&newfs_log_thread, NULL, newfs_log_worker, NULL) == 0;
+    return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 写出剩余日志，停止后台线程并关闭日志文件
+ */
+void newfs_log_stop_drain(void) {
+    if (newfs_log_running) {
+        newfs_log_stop = true;
+        pthread_join(newfs_log_thread, NULL);
+        newfs_log_running = false;
+    }
+    if (newfs_log_fp != NULL && newfs_log_fp != stderr) {
+        fclose(newfs_log_fp);
+    }
+    newfs_log_fp = NULL;
+}
@@ -9,35 +9,53 @@
 /******************************************************************************
 * SECTION: 全局变量
 *******************************************************************************/
+#ifndef NEWFS_BENCH                                /* 只有FUSE入口main用到 */
 static const struct fuse_opt option_spec[] = {		/* 用于FUSE文件系统解析参数 */
 	OPTION("--device=%s", device),
+	OPTION("--scrub_rate=%d", scrub_rate),
+	OPTION("--compress", compress),
+	OPTION("--dedup", dedup),
+	OPTION("--log_level=%d", log_level),
+	OPTION("--log_file=%s", log_file),
+	OPTION("--snapshot=%s", snapshot),
 	FUSE_OPT_END
 };
+#endif /* NEWFS_BENCH */
 
 struct custom_options newfs_options;			 /* 全局选项 */
 struct newfs_super newfs_super; 
 /******************************************************************************
 * SECTION: FUSE操作定义
 *******************************************************************************/
+#ifndef NEWFS_BENCH
 static struct fuse_operations operations = {
 	.init = newfs_init,						 /* mount文件系统 */		
 	.destroy = newfs_destroy,				 /* umount文件系统 */
 	.mkdir = newfs_mkdir,					 /* 建目录，mkdir */
-	.getattr = newfs_getattr,				 /* 获取文件属性，类似stat，必须完成 */
-	.readdir = newfs_readdir,				 /* 填充dentrys */
-	.mknod = newfs_mknod,					 /* 创建文件，touch相关 */
-	.write = newfs_write,								  	 /* 写入文件 */
-	.read = newfs_read,								  	 /* 读文件 */
+	.getattr = newfs_timed_getattr,			 /* 获取文件属性，类似stat，必须完成；newfs_timed_*经stats.c计时后调用实现 */
+	.readdir = newfs_timed_readdir,			 /* 填充dentrys */
+	.mknod = newfs_timed_mknod,				 /* 创建文件，touch相关 */
+	.write = newfs_timed_write,							  	 /* 写入文件 */
+	.read = newfs_timed_read,							  	 /* 读文件 */
 	.utimens = newfs_utimens,				 /* 修改时间，忽略，避免touch报错 */
-	.truncate = NULL,						  		 /* 改变文件大小 */
-	.unlink = NULL,							  		 /* 删除文件 */
-	.rmdir	= NULL,							  		 /* 删除目录， rm -r */
-	.rename = NULL,							  		 /* 重命名，mv */
-
-	.open = NULL,							
+	.truncate = newfs_truncate,						 /* 改变文件大小 */
+	.unlink = newfs_unlink,							 /* 删除文件 */
+	.rmdir	= newfs_rmdir,							 /* 删除目录， rm -r */
+	.rename = newfs_rename,							 /* 重命名，mv */
+	.fallocate = newfs_fallocate,					 /* 预分配连续空间 */
+	.setxattr = newfs_setxattr,						 /* 扩展属性，setfattr/getfattr */
+	.getxattr = newfs_getxattr,
+	.listxattr = newfs_listxattr,
+	.removexattr = newfs_removexattr,
+#if FUSE_MAJOR_VERSION >= 3
+	.copy_file_range = newfs_copy_file_range,		 /* 克隆拷贝，需libfuse 3.4+ */
+#endif
+
+	.open = newfs_open,						 /* 统计文件需direct_io */
 	.opendir = NULL,
 	.access = NULL
 };
+#endif /* NEWFS_BENCH */
 /******************************************************************************
 * SECTION: 必做函数实现
 *******************************************************************************/
@@ -53,7 +71,32 @@ char* newfs_get_fname(const char* path) {
     return q;
 }
 /**
- * @brief 驱动读
+ * @brief 校验[offset_aligned, offset_aligned + size)范围内的已分配数据块
+ * 
+ * @param offset_aligned 按逻辑块对齐的磁盘偏移
+ * @param content 该范围的内容
+ * @param size 按逻辑块对齐的大小
+ * @return int 0成功，校验失败返回-NEWFS_ERROR_IO
+ */
+int newfs_csum_verify(int offset_aligned, uint8_t* content, int size) {
+    int blk_ofs = offset_aligned < NEWFS_DA_OFS(0) ? NEWFS_DA_OFS(0) : offset_aligned;
+    int blk;
+    for (; blk_ofs < offset_aligned + size && blk_ofs < NEWFS_DA_END(); blk_ofs += NEWFS_BLKS_SZ()) {
+        blk = NEWFS_DA_BLK(blk_ofs);
+        if (!(newfs_super.map_data[blk / UINT8_BITS] & (0x1 << (blk % UINT8_BITS))) ||
+            (newfs_super.map_unwritten[blk / UINT8_BITS] & (0x1 << (blk % UINT8_BITS)))) {
+            continue;                                 /* 未分配或分配后还没写过的块没有有效校验和 */
+        }
+        if (newfs_crc32c(content + blk_ofs - offset_aligned, NEWFS_BLKS_SZ()) != newfs_super.map_csum[blk]) {
+            newfs_super.csum_errors++;
+            NEWFS_ERR("[%s] checksum mismatch on data block %d\n", __func__, blk);
+            return -NEWFS_ERROR_IO;
+        }
+    }
+    return NEWFS_ERROR_NONE;
+}
+/**
+ * @brief 驱动读，读到数据区的已分配块时核对校验和
  * 
  * @param offset 
  * @param out_content 
@@ -64,23 +107,32 @@ int newfs_driver_read(int offset, uint8_t *out_content, int size) {
     int      offset_aligned = NEWFS_ROUND_DOWN(offset, NEWFS_BLKS_SZ());
     int      bias           = offset - offset_aligned;
     int      size_aligned   = NEWFS_ROUND_UP((size + bias), NEWFS_BLKS_SZ());
+    int      size_left      = size_aligned;
+    int      ret            = NEWFS_ERROR_NONE;
     uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
     uint8_t* cur            = temp_content;
+    pthread_mutex_lock(&newfs_super.driver_lock);
     // lseek(NEWFS_DRIVER(), offset_aligned, SEEK_SET);
     ddriver_seek(NEWFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
+    while (size_left != 0)
     {
         // read(NEWFS_DRIVER(), cur, NEWFS_IO_SZ());
         ddriver_read(NEWFS_DRIVER(), cur, NEWFS_IOBLOCK_SZ());
         cur          += NEWFS_IOBLOCK_SZ();
-        size_aligned -= NEWFS_IOBLOCK_SZ();   
+        size_left    -= NEWFS_IOBLOCK_SZ();   
     }
+    if (offset_aligned + size_aligned > NEWFS_DA_OFS(0) && newfs_super.map_csum != NULL) {
+        ret = newfs_csum_verify(offset_aligned, temp_content, size_aligned);
+    }
+    pthread_mutex_unlock(&newfs_super.driver_lock);
+    NEWFS_STAT(dev_rd_ios, 1);
+    NEWFS_STAT(dev_rd_bytes, size_aligned);
     memcpy(out_content, temp_content + bias, size);
     free(temp_content);
-    return NEWFS_ERROR_NONE;
+    return ret;
 }
 /**
- * @brief 驱动写
+ * @brief 驱动写，写数据区时同步更新对应块的校验和
  * 
  * @param offset 
  * @param in_content 
@@ -91,24 +143,66 @@ int newfs_driver_write(int offset, uint8_t *in_content, int size) {
     int      offset_aligned = NEWFS_ROUND_DOWN(offset, NEWFS_BLKS_SZ());
     int      bias           = offset - offset_aligned;
     int      size_aligned   = NEWFS_ROUND_UP((size + bias), NEWFS_BLKS_SZ());
+    int      size_left      = size_aligned;
+    int      blk_ofs, blk;
     uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
     uint8_t* cur            = temp_content;
-    newfs_driver_read(offset_aligned, temp_content, size_aligned);
+    if (bias != 0 || size != size_aligned) {          /* 整块覆盖时无需先读 */
+        if (newfs_driver_read(offset_aligned, temp_content, size_aligned) != NEWFS_ERROR_NONE) {
+            free(temp_content);                       /* 不能为已损坏的内容算出新校验和 */
+            return -NEWFS_ERROR_IO;
+        }
+    }
     memcpy(temp_content + bias, in_content, size);
     
+    pthread_mutex_lock(&newfs_super.driver_lock);
+    for (blk_ofs = offset_aligned < NEWFS_DA_OFS(0) ? NEWFS_DA_OFS(0) : offset_aligned; 
+         blk_ofs < offset_aligned + size_aligned && blk_ofs < NEWFS_DA_END(); blk_ofs += NEWFS_BLKS_SZ()) {
+        blk = NEWFS_DA_BLK(blk_ofs);
+        newfs_super.map_csum[blk] = newfs_crc32c(temp_content + blk_ofs - offset_aligned, NEWFS_BLKS_SZ());
+        newfs_super.map_unwritten[blk / UINT8_BITS] &= ~(0x1 << (blk % UINT8_BITS));
+    }
     // lseek(NEWFS_DRIVER(), offset_aligned, SEEK_SET);
     ddriver_seek(NEWFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
+    while (size_left != 0)
     {
         // write(NEWFS_DRIVER(), cur, NEWFS_IO_SZ());
         ddriver_write(NEWFS_DRIVER(), cur, NEWFS_IOBLOCK_SZ());
         cur          += NEWFS_IOBLOCK_SZ();
-        size_aligned -= NEWFS_IOBLOCK_SZ();   
+        size_left    -= NEWFS_IOBLOCK_SZ();   
     }
+    pthread_mutex_unlock(&newfs_super.driver_lock);
+    NEWFS_STAT(dev_wr_ios, 1);
+    NEWFS_STAT(dev_wr_bytes, size_aligned);
 
     free(temp_content);
     return NEWFS_ERROR_NONE;
 }
+/**
+ * @brief 后台校验线程：以最低优先级逐个读取已分配数据块并核对校验和，
+ * 每块之间休眠以限制速率，避免影响前台请求
+ * 
+ * @param arg 每秒校验的块数
+ * @return void* 
+ */
+void* newfs_scrub_worker(void* arg) {
+    int      rate    = *(int *)arg;
+    int      blk     = 0;
+    uint8_t* blk_buf = (uint8_t *)malloc(NEWFS_BLKS_SZ());
+    setpriority(PRIO_PROCESS, 0, 19);                 /* Linux下只影响当前线程 */
+    while (!newfs_super.scrub_stop) {
+        if (newfs_super.map_data[blk / UINT8_BITS] & (0x1 << (blk % UINT8_BITS))) {
+            usleep(1000000 / rate);
+            newfs_driver_read(NEWFS_DA_OFS(blk), blk_buf, NEWFS_BLKS_SZ());
+        }
+        blk = (blk + 1) % newfs_super.max_data;
+        if (blk == 0) {                               /* 一轮结束，空盘时也不空转 */
+            usleep(1000000 / rate);
+        }
+    }
+    free(blk_buf);
+    return NULL;
+}
 
 struct newfs_dentry* new_dentry(char * fname, NEWFS_FILE_TYPE ftype) {
     struct newfs_dentry * dentry = (struct newfs_dentry *)malloc(sizeof(struct newfs_dentry));
@@ -120,314 +214,1455 @@ struct newfs_dentry* new_dentry(char * fname, NEWFS_FILE_TYPE ftype) {
     dentry->valid   = 0;       
     return  dentry;
 }
-
 /**
- * @brief 
+ * @brief 在位图中分配一个空闲位
  * 
- * @param inode 
- * @param dir [0...]
- * @return struct sfs_dentry* 
+ * @param map 位图
+ * @param max 位图中有效位数量
+ * @return int 分配到的下标，-1表示没有空闲位
  */
-struct newfs_dentry* newfs_get_dentry(struct newfs_inode * inode, int dir) {
-    struct newfs_dentry* dentry_cursor = inode->dentrys;
-    int    cnt = 0;
-    while (dentry_cursor)
+int newfs_bitmap_alloc(uint8_t* map, int max) {
+    for (int byte_cursor = 0; byte_cursor < NEWFS_ROUND_UP(max, UINT8_BITS) / UINT8_BITS; byte_cursor++)
     {
-        if (dir == cnt) {
-            return dentry_cursor;
+        if (map[byte_cursor] == 0xFF) {               /* 整字节已满，跳过 */
+            continue;
+        }
+        for (int bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
+            int idx = byte_cursor * UINT8_BITS + bit_cursor;
+            if (idx >= max) {
+                return -1;
+            }
+            if ((map[byte_cursor] & (0x1 << bit_cursor)) == 0) {
+                map[byte_cursor] |= (0x1 << bit_cursor);
+                return idx;
+            }
         }
-        cnt++;
-        dentry_cursor = dentry_cursor->brother;
     }
-    return NULL;
+    return -1;
 }
 /**
- * @brief 为一个inode分配dentry，采用头插法
+ * @brief 在位图中分配want个连续空闲位，优先从goal开始
  * 
- * @param inode 
- * @param dentry 
- * @return int 
+ * @param map 位图
+ * @param max 位图中有效位数量
+ * @param goal 期望的起始下标，-1表示不指定
+ * @param want 连续位数量
+ * @return int 分配到的起始下标，-1表示没有足够长的连续空闲区间
  */
-int newfs_alloc_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
-    if (inode->dentrys == NULL) {
-        inode->dentrys = dentry;
-    }
-    else {
-        dentry->brother = inode->dentrys;
-        inode->dentrys = dentry;
-    }
-    //如果分配dentry给inode之后当前拥有的数据块大小不够则分配一个数据块并修改数据位图
-    int data_cursor = 0;
-    bool is_find_free_entry = false;
-    if(NEWFS_ROUND_UP(inode->size,NEWFS_BLKS_SZ()) != NEWFS_ROUND_UP(inode->size + sizeof(struct newfs_dentry),NEWFS_BLKS_SZ()))
-    {
-        for (int byte_cursor = 0; byte_cursor < newfs_super.map_data_blks * NEWFS_BLKS_SZ(); byte_cursor++)
-        {
-            for (int bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-                if((newfs_super.map_data[byte_cursor] & (0x1 << bit_cursor)) == 0) {    
-                                                      /* 当前ino_cursor位置空闲 */
-                    newfs_super.map_data[byte_cursor] |= (0x1 << bit_cursor);
-                    is_find_free_entry = true;           
-                    break;
-                }
-                data_cursor++;
-            }
-            if (is_find_free_entry) {
+int newfs_bitmap_alloc_run(uint8_t* map, int max, int goal, int want) {
+    int run_start = -1, run_len = 0, idx, i;
+    if (goal >= 0 && goal + want <= max) {            /* 先尝试紧接goal的区间 */
+        for (i = 0; i < want; i++) {
+            if (map[(goal + i) / UINT8_BITS] & (0x1 << ((goal + i) % UINT8_BITS))) {
                 break;
             }
         }
+        if (i == want) {
+            run_start = goal;
+            run_len   = want;
+        }
     }
-    if (!is_find_free_entry || data_cursor == newfs_super.max_data)
-        return -NEWFS_ERROR_NOSPACE;
-
-    inode->dir_cnt++;
-    inode->size+=sizeof(struct newfs_dentry);
-    return inode->dir_cnt;
+    for (idx = 0; run_len < want && idx < max; idx++) {
+        if (idx % UINT8_BITS == 0 && map[idx / UINT8_BITS] == 0xFF) {   /* 整字节已满，跳过 */
+            run_len = 0;
+            idx += UINT8_BITS - 1;
+            continue;
+        }
+        if (map[idx / UINT8_BITS] & (0x1 << (idx % UINT8_BITS))) {
+            run_len = 0;
+            continue;
+        }
+        if (run_len == 0) {
+            run_start = idx;
+        }
+        run_len++;
+    }
+    if (run_len < want) {
+        return -1;
+    }
+    for (i = 0; i < want; i++) {
+        map[(run_start + i) / UINT8_BITS] |= (0x1 << ((run_start + i) % UINT8_BITS));
+    }
+    return run_start;
 }
 /**
- * @brief 将内存inode及其下方结构全部刷回磁盘
+ * @brief 释放位图中的一位
  * 
- * @param inode 
- * @return int 
+ * @param map 位图
+ * @param idx 下标
  */
-int newfs_sync_inode(struct newfs_inode * inode) {
-    struct newfs_inode_d  inode_d;
-    struct newfs_dentry*  dentry_cursor;
-    struct newfs_dentry_d dentry_d;
-    int ino             = inode->ino;
-    inode_d.ino         = ino;
-    inode_d.size        = inode->size;
-    inode_d.ftype       = inode->dentry->ftype;
-    inode_d.dir_cnt     = inode->dir_cnt;
-    int offset;
-    if (newfs_driver_write(NEWFS_INO_OFS(ino), (uint8_t *)&inode_d, 
-                     sizeof(struct newfs_inode_d)) != NEWFS_ERROR_NONE) {
-        NEWFS_DBG("[%s] io error\n", __func__);
-        return -NEWFS_ERROR_IO;
+void newfs_bitmap_free(uint8_t* map, int idx) {
+    map[idx / UINT8_BITS] &= ~(0x1 << (idx % UINT8_BITS));
+}
+/**
+ * @brief 分配want个连续数据块，并标记为未写入：磁盘上还是旧内容，第一次写入前不核对校验和。
+ * 两张位图在driver_lock下一起修改，持锁核对校验和的校验线程不会看到已分配、未标记的块
+ * 
+ * @param goal 期望的起始块号，-1表示不指定
+ * @param want 连续块数
+ * @return int 起始数据块号，-1表示没有足够长的连续空闲区间
+ */
+int newfs_data_alloc(int goal, int want) {
+    int start;
+    pthread_mutex_lock(&newfs_super.driver_lock);
+    start = newfs_bitmap_alloc_run(newfs_super.map_data, newfs_super.max_data, goal, want);
+    for (int blk = start; start >= 0 && blk < start + want; blk++) {
+        newfs_super.map_unwritten[blk / UINT8_BITS] |= 0x1 << (blk % UINT8_BITS);
     }
-                                                      /* Cycle 1: 写 INODE */
-                                                      /* Cycle 2: 写 数据 */
-    if (NEWFS_IS_DIR(inode)) {                          
-        dentry_cursor = inode->dentrys;
-        offset        = NEWFS_DA_OFS(ino);
-        while (dentry_cursor != NULL)
-        {
-            memcpy(dentry_d.fname, dentry_cursor->fname, NEWFS_MAX_FILE_NAME);
-            dentry_d.ftype = dentry_cursor->ftype;
-            dentry_d.ino = dentry_cursor->ino;
-            if (newfs_driver_write(offset, (uint8_t *)&dentry_d, 
-                                 sizeof(struct newfs_dentry_d)) != NEWFS_ERROR_NONE) {
-                NEWFS_DBG("[%s] io error\n", __func__);
-                return -NEWFS_ERROR_IO;                     
-            }
-            
-            if (dentry_cursor->inode != NULL) {
-                newfs_sync_inode(dentry_cursor->inode);
-            }
-
-            dentry_cursor = dentry_cursor->brother;
-            offset += sizeof(struct newfs_dentry_d);
-        }
+    pthread_mutex_unlock(&newfs_super.driver_lock);
+    return start;
+}
+/**
+ * @brief 将数据块移出指纹索引
+ * 
+ * @param data_blk 数据块号
+ */
+void newfs_dedup_remove(int data_blk) {
+    struct newfs_dedup_node* node;
+    if (newfs_super.dedup_nodes == NULL || !newfs_super.dedup_nodes[data_blk].linked) {
+        return;
     }
-    else if (NEWFS_IS_REG(inode)) {
-        if (newfs_driver_write(NEWFS_DA_OFS(ino), inode->data, 
-                            NEWFS_ROUND_UP(inode->size, NEWFS_BLKS_SZ())) != NEWFS_ERROR_NONE) {
-            NEWFS_DBG("[%s] io error\n", __func__);
-            return -NEWFS_ERROR_IO;
-        }
+    node = &newfs_super.dedup_nodes[data_blk];
+    if (node->prev >= 0) {
+        newfs_super.dedup_nodes[node->prev].next = node->next;
     }
-    return NEWFS_ERROR_NONE;
+    else {
+        newfs_super.dedup_head[node->fp % NEWFS_DEDUP_BUCKETS] = node->next;
+    }
+    if (node->next >= 0) {
+        newfs_super.dedup_nodes[node->next].prev = node->prev;
+    }
+    node->linked = false;
 }
 /**
- * @brief 分配一个inode，占用位图
+ * @brief 以指纹fp将数据块加入指纹索引，已在索引中则先移出
  * 
- * @param dentry 该dentry指向分配的inode
- * @return newfs_inode
+ * @param data_blk 数据块号
+ * @param fp 块内容的CRC32C
  */
-struct newfs_inode* newfs_alloc_inode(struct newfs_dentry * dentry) {
-    struct newfs_inode* inode;
-    int byte_cursor = 0; 
-    int bit_cursor  = 0; 
-    int ino_cursor  = 0;
-    bool is_find_free_entry = false;
-
-    for (byte_cursor = 0; byte_cursor < newfs_super.map_inode_blks * NEWFS_BLKS_SZ(); 
-         byte_cursor++)
-    {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            if((newfs_super.map_inode[byte_cursor] & (0x1 << bit_cursor)) == 0) {    
-                                                      /* 当前ino_cursor位置空闲 */
-                newfs_super.map_inode[byte_cursor] |= (0x1 << bit_cursor);
-                is_find_free_entry = true;           
-                break;
-            }
-            ino_cursor++;
+void newfs_dedup_insert(int data_blk, uint32_t fp) {
+    struct newfs_dedup_node* node;
+    int bucket = fp % NEWFS_DEDUP_BUCKETS;
+    if (newfs_super.dedup_nodes == NULL) {
+        return;
+    }
+    newfs_dedup_remove(data_blk);
+    node         = &newfs_super.dedup_nodes[data_blk];
+    node->fp     = fp;
+    node->prev   = -1;
+    node->next   = newfs_super.dedup_head[bucket];
+    node->linked = true;
+    if (node->next >= 0) {
+        newfs_super.dedup_nodes[node->next].prev = data_blk;
+    }
+    newfs_super.dedup_head[bucket] = data_blk;
+}
+/**
+ * @brief 查找磁盘上内容与content完全相同的数据块
+ * 
+ * 索引按指纹惰性维护：候选块须仍已分配且校验和表中的CRC与指纹一致，
+ * 否则视为过期并移出；指纹命中后再读出候选块逐字节比较，哈希碰撞不会导致错误共享
+ * 
+ * @param content 一个逻辑块的内容
+ * @param fp content的CRC32C
+ * @param self 不与之比较的块号（通常为该逻辑块当前所在的数据块）
+ * @return int 相同内容的数据块号，没有返回-1
+ */
+int newfs_dedup_find(const uint8_t* content, uint32_t fp, int self) {
+    uint8_t* blk_buf;
+    int      cand, next, ret = -1;
+    if (newfs_super.dedup_nodes == NULL) {
+        return -1;
+    }
+    blk_buf = (uint8_t *)malloc(NEWFS_BLKS_SZ());
+    for (cand = newfs_super.dedup_head[fp % NEWFS_DEDUP_BUCKETS]; cand >= 0; cand = next) {
+        next = newfs_super.dedup_nodes[cand].next;
+        if (!(newfs_super.map_data[cand / UINT8_BITS] & (0x1 << (cand % UINT8_BITS))) ||
+            newfs_super.map_csum[cand] != newfs_super.dedup_nodes[cand].fp) {
+            newfs_dedup_remove(cand);
+            continue;
         }
-        if (is_find_free_entry) {
+        if (cand == self || newfs_super.dedup_nodes[cand].fp != fp || 
+            newfs_super.map_ref[cand] >= NEWFS_REF_MAX) {
+            continue;
+        }
+        if (newfs_driver_read(NEWFS_DA_OFS(cand), blk_buf, NEWFS_BLKS_SZ()) == NEWFS_ERROR_NONE &&
+            memcmp(blk_buf, content, NEWFS_BLKS_SZ()) == 0) {
+            ret = cand;
             break;
         }
     }
-
-    if (!is_find_free_entry || ino_cursor == newfs_super.max_ino)
-        return -NEWFS_ERROR_NOSPACE;
-
-    inode = (struct newfs_inode*)malloc(sizeof(struct newfs_inode));
-    inode->ino  = ino_cursor; 
-    inode->size = 0;
-                                                      /* dentry指向inode */
-    dentry->inode = inode;
-    dentry->ino   = inode->ino;
-                                                      /* inode指回dentry */
-    inode->dentry = dentry;
-    
-    inode->dir_cnt = 0;
-    inode->dentrys = NULL;
-
-	if (NEWFS_IS_REG(inode)) {
-        inode->data = (uint8_t*)malloc(NEWFS_DATA_PER_FILE * NEWFS_BLKS_SZ());
+    free(blk_buf);
+    return ret;
+}
+/**
+ * @brief 归还一个数据块的引用，最后一个引用释放时才清除数据位图
+ * 
+ * @param data_blk 数据块号
+ */
+void newfs_put_block(int data_blk) {
+    if (newfs_super.map_ref[data_blk] > 0) {
+        newfs_super.map_ref[data_blk]--;
+        return;
     }
-    return inode;
+    newfs_dedup_remove(data_blk);
+    newfs_bitmap_free(newfs_super.map_data, data_blk);
+    newfs_super.sz_usage -= NEWFS_BLKS_SZ();
 }
 /**
- * @brief 
+ * @brief 为inode的第blk个逻辑块分配数据块，已分配则直接返回
  * 
- * @param dentry dentry指向ino，读取该inode
- * @param ino inode唯一编号
- * @return struct newfs_inode* 
+ * @param inode 
+ * @param blk 文件内逻辑块号
+ * @return int 0成功，否则-NEWFS_ERROR_NOSPACE
  */
-struct newfs_inode* newfs_read_inode(struct newfs_dentry * dentry, int ino) {
-    struct newfs_inode* inode = (struct newfs_inode*)malloc(sizeof(struct newfs_inode));
-    struct newfs_inode_d inode_d;
-    struct newfs_dentry* sub_dentry;
-    struct newfs_dentry_d dentry_d;
-    int    dir_cnt = 0, i;
-    if (newfs_driver_read(NEWFS_INO_OFS(ino), (uint8_t *)&inode_d, 
-                        sizeof(struct newfs_inode_d)) != NEWFS_ERROR_NONE) {
-        NEWFS_DBG("[%s] io error\n", __func__);
-        return NULL;                    
+int newfs_alloc_block(struct newfs_inode* inode, int blk) {
+    int data_blk, goal = -1;
+    if (inode->block_pointer[blk] >= 0) {
+        return NEWFS_ERROR_NONE;
     }
-    inode->dir_cnt = 0;
-    inode->ino = inode_d.ino;
-    inode->size = inode_d.size;
-    inode->dentry = dentry;
-    inode->dentrys = NULL;
-    if (NEWFS_IS_DIR(inode)) {
-        dir_cnt = inode_d.dir_cnt;
-        for (i = 0; i < dir_cnt; i++)
-        {
-            if (newfs_driver_read(NEWFS_DA_OFS(ino) + i * sizeof(struct newfs_dentry_d), 
-                                (uint8_t *)&dentry_d, 
-                                sizeof(struct newfs_dentry_d)) != NEWFS_ERROR_NONE) {
-                NEWFS_DBG("[%s] io error\n", __func__);
-                return NULL;                    
-            }
-            sub_dentry = new_dentry(dentry_d.fname, dentry_d.ftype);
-            sub_dentry->parent = inode->dentry;
-            sub_dentry->ino    = dentry_d.ino; 
-            newfs_alloc_dentry(inode, sub_dentry);
-        }
+    if (blk > 0 && inode->block_pointer[blk - 1] >= 0) {   /* 优先紧跟前一块，保持物理连续 */
+        goal = inode->block_pointer[blk - 1] + 1;
     }
-    else if (NEWFS_IS_REG(inode)) {
-        inode->data = (uint8_t *)malloc(NEWFS_DATA_PER_FILE * NEWFS_BLKS_SZ());
-        if (newfs_driver_read(NEWFS_DA_OFS(ino), (uint8_t*)inode->data, 
-                            NEWFS_DATA_PER_FILE * NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
-            NEWFS_DBG("[%s] io error\n", __func__);
-            return NULL;                    
-        }
+    data_blk = newfs_data_alloc(goal, 1);
+    if (data_blk < 0) {
+        return -NEWFS_ERROR_NOSPACE;
     }
-    return inode;
+    inode->block_pointer[blk] = data_blk;
+    inode->dirty |= 0x1 << blk;                       /* 新块的磁盘内容无效 */
+    newfs_super.sz_usage += NEWFS_BLKS_SZ();
+    return NEWFS_ERROR_NONE;
 }
 /**
- * @brief 
- * path: /qwe/ad  total_lvl = 2,
- *      1) find /'s inode       lvl = 1
- *      2) find qwe's dentry 
- *      3) find qwe's inode     lvl = 2
- *      4) find ad's dentry
- *
- * path: /qwe     total_lvl = 1,
- *      1) find /'s inode       lvl = 1
- *      2) find qwe's dentry
+ * @brief 为inode的[from, to)逻辑块预留一段物理连续的数据块
  * 
- * @param path 
- * @return struct newfs_inode* 
+ * 区间内已分配的块保持不变；其余块尽量取一段连续区间，没有足够长的空闲区间时逐块分配
+ * 
+ * @param inode 
+ * @param from 起始逻辑块号
+ * @param to 结束逻辑块号（不含）
+ * @return int 0成功，否则-NEWFS_ERROR_NOSPACE
  */
-struct newfs_dentry* newfs_lookup(const char * path, bool* is_find, bool* is_root) {
-    struct newfs_dentry* dentry_cursor = newfs_super.root_dentry;
-    struct newfs_dentry* dentry_ret = NULL;
-    struct newfs_inode*  inode; 
-    int   total_lvl = newfs_calc_lvl(path);
-    int   lvl = 0;
-    bool is_hit;
-    char* fname = NULL;
-    char* path_cpy = (char*)malloc(sizeof(path));
-    *is_root = false;
-    strcpy(path_cpy, path);
-
-    if (total_lvl == 0) {                           /* 根目录 */
-        *is_find = true;
-        *is_root = true;
-        dentry_ret = newfs_super.root_dentry;
-    }
-    fname = strtok(path_cpy, "/");       
-    while (fname)
-    {   
-        lvl++;
-        if (dentry_cursor->inode == NULL) {           /* Cache机制 */
-            newfs_read_inode(dentry_cursor, dentry_cursor->ino);
+int newfs_alloc_extent(struct newfs_inode* inode, int from, int to) {
+    int first = -1, last = -1, goal = -1, start, blk;
+    for (blk = from; blk < to; blk++) {
+        if (inode->block_pointer[blk] < 0) {
+            first = first < 0 ? blk : first;
+            last  = blk;
         }
-
-        inode = dentry_cursor->inode;
-
-        if (NEWFS_IS_REG(inode) && lvl < total_lvl) {
-            NEWFS_DBG("[%s] not a dir\n", __func__);
-            dentry_ret = inode->dentry;
+    }
+    if (first < 0) {
+        return NEWFS_ERROR_NONE;
+    }
+    for (blk = first; blk <= last; blk++) {           /* 中间已有块则无法整体连续 */
+        if (inode->block_pointer[blk] >= 0) {
             break;
         }
-        if (NEWFS_IS_DIR(inode)) {
-            dentry_cursor = inode->dentrys;
-            is_hit        = false;
-
-            while (dentry_cursor)
-            {
-                if (memcmp(dentry_cursor->fname, fname, strlen(fname)) == 0) {
-                    is_hit = true;
-                    break;
-                }
-                dentry_cursor = dentry_cursor->brother;
-            }
-            
-            if (!is_hit) {
-                *is_find = false;
-                NEWFS_DBG("[%s] not found %s\n", __func__, fname);
-                dentry_ret = inode->dentry;
-                break;
-            }
-
-            if (is_hit && lvl == total_lvl) {
-                *is_find = true;
-                dentry_ret = dentry_cursor;
-                break;
+    }
+    if (blk > last) {
+        if (first > 0 && inode->block_pointer[first - 1] >= 0) {
+            goal = inode->block_pointer[first - 1] + 1;
+        }
+        start = newfs_data_alloc(goal, last - first + 1);
+        if (start >= 0) {
+            for (blk = first; blk <= last; blk++) {
+                inode->block_pointer[blk] = start + blk - first;
+                inode->dirty |= 0x1 << blk;
             }
+            newfs_super.sz_usage += (last - first + 1) * NEWFS_BLKS_SZ();
+            return NEWFS_ERROR_NONE;
         }
-        fname = strtok(NULL, "/"); 
     }
-
-    if (dentry_ret->inode == NULL) {
-        dentry_ret->inode = newfs_read_inode(dentry_ret, dentry_ret->ino);
+    for (blk = first; blk <= last; blk++) {
+        if (newfs_alloc_block(inode, blk) != NEWFS_ERROR_NONE) {
+            return -NEWFS_ERROR_NOSPACE;
+        }
     }
-    
-    return dentry_ret;
+    return NEWFS_ERROR_NONE;
 }
 /**
- * @brief 挂载（mount）文件系统
+ * @brief 在数据缓冲区与磁盘之间搬运普通文件的全部数据块，物理连续的块合并为一次驱动IO
  * 
- * @param conn_info 可忽略，一些建立连接相关的信息 
- * @return void*
+ * @param inode 
+ * @param buf 按逻辑块排列的缓冲区，未压缩时即inode->data
+ * @param is_write true写回磁盘，false从磁盘读入
+ * @return int 
  */
-void* newfs_init(struct fuse_conn_info * conn_info) {
-	/* TODO: 在这里进行挂载 */
-
+int newfs_transfer_data(struct newfs_inode* inode, uint8_t* buf, bool is_write) {
+    int blk = 0, run, ret;
+    while (blk < NEWFS_DATA_PER_FILE) {
+        if (inode->block_pointer[blk] < 0) {
+            blk++;
+            continue;
+        }
+        run = 1;
+        while (blk + run < NEWFS_DATA_PER_FILE && 
+               inode->block_pointer[blk + run] == inode->block_pointer[blk] + run) {
+            run++;
+        }
+        if (is_write) {
+            ret = newfs_driver_write(NEWFS_DA_OFS(inode->block_pointer[blk]), 
+                                     buf + blk * NEWFS_BLKS_SZ(), run * NEWFS_BLKS_SZ());
+        }
+        else {
+            ret = newfs_driver_read(NEWFS_DA_OFS(inode->block_pointer[blk]), 
+                                    buf + blk * NEWFS_BLKS_SZ(), run * NEWFS_BLKS_SZ());
+        }
+        if (ret != NEWFS_ERROR_NONE) {
+            return -NEWFS_ERROR_IO;
+        }
+        blk += run;
+    }
+    return NEWFS_ERROR_NONE;
+}
+/**
+ * @brief 释放inode在[from, to)区间内的数据块
+ * 
+ * @param block_pointer inode的数据块号数组
+ * @param from 起始逻辑块号
+ * @param to 结束逻辑块号（不含）
+ */
+void newfs_free_blocks(int* block_pointer, int from, int to) {
+    for (int blk = from; blk < to; blk++) {
+        if (block_pointer[blk] >= 0) {
+            newfs_put_block(block_pointer[blk]);
+            block_pointer[blk] = -1;
+        }
+    }
+}
+/**
+ * @brief 写时复制：修改[from, to)逻辑块前，为其中与其他文件共享的块换上私有数据块
+ * 
+ * 文件数据常驻内存缓冲区，新块内容在下次刷盘时写出，这里只需改指针
+ * 
+ * @param inode 
+ * @param from 起始逻辑块号
+ * @param to 结束逻辑块号（不含）
+ * @return int 0成功，否则-NEWFS_ERROR_NOSPACE
+ */
+int newfs_cow_blocks(struct newfs_inode* inode, int from, int to) {
+    int shared;
+    for (int blk = from; blk < to; blk++) {
+        shared = inode->block_pointer[blk];
+        if (shared < 0 || newfs_super.map_ref[shared] == 0) {
+            continue;
+        }
+        inode->block_pointer[blk] = -1;
+        if (newfs_alloc_block(inode, blk) != NEWFS_ERROR_NONE) {
+            inode->block_pointer[blk] = shared;
+            return -NEWFS_ERROR_NOSPACE;
+        }
+        newfs_super.map_ref[shared]--;
+    }
+    return NEWFS_ERROR_NONE;
+}
+/**
+ * @brief 刷盘时写回普通文件的脏块，物理连续的脏块合并为一次驱动IO
+ * 
+ * 与其他文件共享的脏块先写时复制，避免覆盖共享内容；开启去重时，
+ * 内容与磁盘上已有块相同的脏块直接共享该块并增加引用计数，不再写盘
+ * 
+ * @param inode 
+ * @return int 0成功，否则-NEWFS_ERROR_NOSPACE或-NEWFS_ERROR_IO
+ */
+int newfs_flush_data(struct newfs_inode* inode) {
+    uint32_t fp[NEWFS_DATA_PER_FILE];
+    int      blk, run, dup;
+    for (blk = 0; blk < NEWFS_DATA_PER_FILE; blk++) {
+        if (inode->block_pointer[blk] < 0 || !(inode->dirty & (0x1 << blk))) {
+            continue;
+        }
+        if (newfs_cow_blocks(inode, blk, blk + 1) != NEWFS_ERROR_NONE) {
+            return -NEWFS_ERROR_NOSPACE;
+        }
+        fp[blk] = newfs_crc32c(inode->data + blk * NEWFS_BLKS_SZ(), NEWFS_BLKS_SZ());
+        if (!newfs_options.dedup || blk * NEWFS_BLKS_SZ() >= inode->size) {
+            continue;                                 /* EOF之后为预分配块，保持其私有与连续 */
+        }
+        dup = newfs_dedup_find(inode->data + blk * NEWFS_BLKS_SZ(), fp[blk], inode->block_pointer[blk]);
+        if (dup >= 0) {
+            newfs_put_block(inode->block_pointer[blk]);
+            inode->block_pointer[blk] = dup;
+            newfs_super.map_ref[dup]++;
+            newfs_super.dedup_hits++;
+            inode->dirty &= ~(0x1 << blk);
+        }
+    }
+    blk = 0;
+    while (blk < NEWFS_DATA_PER_FILE) {
+        if (inode->block_pointer[blk] < 0 || !(inode->dirty & (0x1 << blk))) {
+            blk++;
+            continue;
+        }
+        run = 1;
+        while (blk + run < NEWFS_DATA_PER_FILE && (inode->dirty & (0x1 << (blk + run))) &&
+               inode->block_pointer[blk + run] == inode->block_pointer[blk] + run) {
+            run++;
+        }
+        if (newfs_driver_write(NEWFS_DA_OFS(inode->block_pointer[blk]), 
+                               inode->data + blk * NEWFS_BLKS_SZ(), run * NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+            return -NEWFS_ERROR_IO;
+        }
+        for (; run > 0; run--, blk++) {
+            newfs_dedup_insert(inode->block_pointer[blk], fp[blk]);
+        }
+    }
+    inode->dirty = 0;
+    return NEWFS_ERROR_NONE;
+}
+/**
+ * @brief 标记[from, to)逻辑块的内存内容已修改，下次刷盘时写回
+ * 
+ * @param inode 
+ * @param from 起始逻辑块号
+ * @param to 结束逻辑块号（不含）
+ */
+void newfs_mark_dirty(struct newfs_inode* inode, int from, int to) {
+    for (int blk = from; blk < to && blk < NEWFS_DATA_PER_FILE; blk++) {
+        inode->dirty |= 0x1 << blk;
+    }
+}
+/**
+ * @brief 刷盘前尝试压缩普通文件：整个文件视为一个extent，压缩后放入block_pointer前若干块
+ * 
+ * 仅在至少节省一个数据块、且有空闲块放下新extent时压缩；含共享块（克隆）的文件不压缩，以免破坏引用计数。
+ * 压缩后数据缓冲区仍保存明文，在再次修改前内存与磁盘一致，刷盘时无需重写数据
+ * 
+ * @param inode 
+ * @return int 0成功（含不压缩的情况），否则-NEWFS_ERROR_IO
+ */
+int newfs_deflate(struct newfs_inode* inode) {
+    uint8_t* cbuf;
+    int      used = 0, clen, nblks, old[NEWFS_DATA_PER_FILE], old_dirty = inode->dirty;
+    for (int blk = 0; blk < NEWFS_DATA_PER_FILE; blk++) {
+        if (inode->block_pointer[blk] < 0) {
+            continue;
+        }
+        if (newfs_super.map_ref[inode->block_pointer[blk]] > 0) {
+            return NEWFS_ERROR_NONE;
+        }
+        used++;
+    }
+    if (used <= 1 || inode->size == 0) {
+        return NEWFS_ERROR_NONE;
+    }
+    cbuf = (uint8_t *)calloc(1, NEWFS_FILE_MAX_SZ());
+    clen = newfs_compress(inode->data, inode->size, cbuf, (used - 1) * NEWFS_BLKS_SZ());
+    if (clen < 0) {                                   /* 不可压缩 */
+        free(cbuf);
+        return NEWFS_ERROR_NONE;
+    }
+    nblks = NEWFS_ROUND_UP(clen, NEWFS_BLKS_SZ()) / NEWFS_BLKS_SZ();
+    memcpy(old, inode->block_pointer, sizeof(old));   /* 先分配新extent再归还原数据块，分配失败时保持未压缩 */
+    memset(inode->block_pointer, -1, sizeof(inode->block_pointer));
+    if (newfs_alloc_extent(inode, 0, nblks) != NEWFS_ERROR_NONE) {
+        newfs_free_blocks(inode->block_pointer, 0, NEWFS_DATA_PER_FILE);
+        memcpy(inode->block_pointer, old, sizeof(old));
+        inode->dirty = old_dirty;
+        free(cbuf);
+        return NEWFS_ERROR_NONE;
+    }
+    newfs_free_blocks(old, 0, NEWFS_DATA_PER_FILE);
+    inode->flags |= NEWFS_INODE_COMPRESSED;
+    inode->csize  = clen;
+    if (newfs_transfer_data(inode, cbuf, true) != NEWFS_ERROR_NONE) {
+        free(cbuf);
+        return -NEWFS_ERROR_IO;
+    }
+    inode->dirty = 0;
+    free(cbuf);
+    return NEWFS_ERROR_NONE;
+}
+/**
+ * @brief 修改压缩文件前恢复为未压缩布局：为[0, size)的每个逻辑块分配数据块并归还压缩extent
+ * 
+ * 明文常驻数据缓冲区，这里只改块指针，新块内容在下次刷盘时写出
+ * 
+ * @param inode 
+ * @return int 0成功，否则-NEWFS_ERROR_NOSPACE
+ */
+int newfs_inflate(struct newfs_inode* inode) {
+    int old[NEWFS_DATA_PER_FILE];
+    if (!(inode->flags & NEWFS_INODE_COMPRESSED)) {
+        return NEWFS_ERROR_NONE;
+    }
+    memcpy(old, inode->block_pointer, sizeof(old));
+    memset(inode->block_pointer, -1, sizeof(inode->block_pointer));
+    if (newfs_alloc_extent(inode, 0, NEWFS_ROUND_UP(inode->size, NEWFS_BLKS_SZ()) / NEWFS_BLKS_SZ()) 
+        != NEWFS_ERROR_NONE) {
+        newfs_free_blocks(inode->block_pointer, 0, NEWFS_DATA_PER_FILE);
+        memcpy(inode->block_pointer, old, sizeof(old));
+        return -NEWFS_ERROR_NOSPACE;
+    }
+    newfs_free_blocks(old, 0, NEWFS_DATA_PER_FILE);
+    inode->flags &= ~NEWFS_INODE_COMPRESSED;
+    inode->csize  = 0;
+    return NEWFS_ERROR_NONE;
+}
+/**
+ * @brief 在xattr区中查找名为name的条目
+ * 
+ * @param area 内联区或xattr块
+ * @param area_sz 区域大小
+ * @param name 
+ * @return int 条目在区域内的偏移，没有返回-1
+ */
+int newfs_xattr_find(uint8_t* area, int area_sz, const char* name) {
+    struct newfs_xattr_d* xattr_d;
+    int ofs = 0, name_len = strlen(name);
+    while (ofs + (int)sizeof(struct newfs_xattr_d) <= area_sz) {
+        xattr_d = (struct newfs_xattr_d *)(area + ofs);
+        if (xattr_d->name_len == 0) {
+            break;
+        }
+        if (xattr_d->name_len == name_len && memcmp(area + ofs + sizeof(struct newfs_xattr_d), name, name_len) == 0) {
+            return ofs;
+        }
+        ofs += sizeof(struct newfs_xattr_d) + xattr_d->name_len + xattr_d->value_len;
+    }
+    return -1;
+}
+/**
+ * @brief 计算xattr区已使用的字节数
+ * 
+ * @param area 
+ * @param area_sz 
+ * @return int 
+ */
+int newfs_xattr_used(uint8_t* area, int area_sz) {
+    struct newfs_xattr_d* xattr_d;
+    int ofs = 0;
+    while (ofs + (int)sizeof(struct newfs_xattr_d) <= area_sz) {
+        xattr_d = (struct newfs_xattr_d *)(area + ofs);
+        if (xattr_d->name_len == 0) {
+            break;
+        }
+        ofs += sizeof(struct newfs_xattr_d) + xattr_d->name_len + xattr_d->value_len;
+    }
+    return ofs;
+}
+/**
+ * @brief 删除偏移ofs处的条目，后续条目前移
+ * 
+ * @param area 
+ * @param area_sz 
+ * @param ofs 
+ */
+void newfs_xattr_del(uint8_t* area, int area_sz, int ofs) {
+    struct newfs_xattr_d* xattr_d = (struct newfs_xattr_d *)(area + ofs);
+    int entry_sz = sizeof(struct newfs_xattr_d) + xattr_d->name_len + xattr_d->value_len;
+    int used     = newfs_xattr_used(area, area_sz);
+    memmove(area + ofs, area + ofs + entry_sz, used - ofs - entry_sz);
+    memset(area + used - entry_sz, 0, entry_sz);
+}
+/**
+ * @brief 在区域末尾追加条目，调用者保证空间足够
+ * 
+ * @param area 
+ * @param area_sz 
+ * @param name 
+ * @param value 
+ * @param size 
+ */
+void newfs_xattr_add(uint8_t* area, int area_sz, const char* name, const char* value, int size) {
+    int                  used = newfs_xattr_used(area, area_sz);
+    struct newfs_xattr_d xattr_d;
+    xattr_d.name_len  = strlen(name);
+    xattr_d.rsv       = 0;
+    xattr_d.value_len = size;
+    memcpy(area + used, &xattr_d, sizeof(struct newfs_xattr_d));
+    memcpy(area + used + sizeof(struct newfs_xattr_d), name, xattr_d.name_len);
+    memcpy(area + used + sizeof(struct newfs_xattr_d) + xattr_d.name_len, value, size);
+}
+/**
+ * @brief 读入inode的xattr块，已读入或没有xattr块时直接返回
+ * 
+ * @param inode 
+ * @return int 0成功，否则-NEWFS_ERROR_IO
+ */
+int newfs_xattr_load(struct newfs_inode* inode) {
+    if (inode->xattr_blk < 0 || inode->xattr_buf != NULL) {
+        return NEWFS_ERROR_NONE;
+    }
+    inode->xattr_buf = (uint8_t *)malloc(NEWFS_BLKS_SZ());
+    if (newfs_driver_read(NEWFS_DA_OFS(inode->xattr_blk), inode->xattr_buf, 
+                          NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+        free(inode->xattr_buf);
+        inode->xattr_buf = NULL;
+        return -NEWFS_ERROR_IO;
+    }
+    return NEWFS_ERROR_NONE;
+}
+/**
+ * @brief 计算文件名哈希
+ * 
+ * @param fname 
+ * @return int 哈希桶号
+ */
+int newfs_hash_fname(const char* fname) {
+    unsigned int hash = 5381;
+    while (*fname) {
+        hash = (hash << 5) + hash + (unsigned char)*fname++;
+    }
+    return hash % NEWFS_DIR_HASH_SZ;
+}
+
+/**
+ * @brief 
+ * 
+ * @param inode 
+ * @param dir [0...]
+ * @return struct sfs_dentry* 
+ */
+struct newfs_dentry* newfs_get_dentry(struct newfs_inode * inode, int dir) {
+    struct newfs_dentry* dentry_cursor = inode->dentrys;
+    int    cnt = 0;
+    while (dentry_cursor)
+    {
+        if (dir == cnt) {
+            return dentry_cursor;
+        }
+        cnt++;
+        dentry_cursor = dentry_cursor->brother;
+    }
+    return NULL;
+}
+/**
+ * @brief 通过目录哈希表查找目录项
+ * 
+ * @param inode 目录inode
+ * @param fname 文件名
+ * @return struct newfs_dentry* 未找到返回NULL
+ */
+struct newfs_dentry* newfs_find_dentry(struct newfs_inode* inode, const char* fname) {
+    struct newfs_dentry* dentry_cursor = inode->dentry_hash[newfs_hash_fname(fname)];
+    while (dentry_cursor)
+    {
+        if (strcmp(dentry_cursor->fname, fname) == 0) {
+            return dentry_cursor;
+        }
+        dentry_cursor = dentry_cursor->hash_next;
+    }
+    return NULL;
+}
+/**
+ * @brief 为一个inode分配dentry，采用头插法
+ * 
+ * @param inode 
+ * @param dentry 
+ * @return int 
+ */
+int newfs_alloc_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    int bucket;
+    //如果分配dentry给inode之后当前拥有的数据块不够则分配一个数据块并修改数据位图
+    //从磁盘读入的目录已有数据块，newfs_alloc_block直接返回
+    if (inode->dir_cnt / NEWFS_DENTRY_PER_BLK() >= NEWFS_DATA_PER_FILE) {
+        return -NEWFS_ERROR_NOSPACE;
+    }
+    if (newfs_alloc_block(inode, inode->dir_cnt / NEWFS_DENTRY_PER_BLK()) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_NOSPACE;
+    }
+
+    dentry->prev_brother = NULL;
+    dentry->brother = inode->dentrys;
+    if (inode->dentrys != NULL) {
+        inode->dentrys->prev_brother = dentry;
+    }
+    inode->dentrys = dentry;
+
+    bucket = newfs_hash_fname(dentry->fname);
+    dentry->hash_next = inode->dentry_hash[bucket];
+    inode->dentry_hash[bucket] = dentry;
+
+    inode->dir_cnt++;
+    inode->size += sizeof(struct newfs_dentry_d);
+    return inode->dir_cnt;
+}
+/**
+ * @brief 将dentry从父目录中摘除，不释放其inode；目录项减少后多出的数据块归还位图
+ * 
+ * @param inode 父目录inode
+ * @param dentry 
+ */
+void newfs_drop_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    struct newfs_dentry** pprev = &inode->dentry_hash[newfs_hash_fname(dentry->fname)];
+    while (*pprev != dentry) {
+        pprev = &(*pprev)->hash_next;
+    }
+    *pprev = dentry->hash_next;
+
+    if (dentry->prev_brother != NULL) {
+        dentry->prev_brother->brother = dentry->brother;
+    }
+    else {
+        inode->dentrys = dentry->brother;
+    }
+    if (dentry->brother != NULL) {
+        dentry->brother->prev_brother = dentry->prev_brother;
+    }
+    dentry->brother      = NULL;
+    dentry->prev_brother = NULL;
+    dentry->hash_next    = NULL;
+
+    inode->dir_cnt--;
+    inode->size -= sizeof(struct newfs_dentry_d);
+    newfs_free_blocks(inode->block_pointer, 
+                      NEWFS_ROUND_UP(inode->dir_cnt, NEWFS_DENTRY_PER_BLK()) / NEWFS_DENTRY_PER_BLK(),
+                      NEWFS_DATA_PER_FILE);
+}
+/**
+ * @brief 将内存inode及其下方结构全部刷回磁盘
+ * 
+ * @param inode 
+ * @return int 
+ */
+int newfs_sync_inode(struct newfs_inode * inode) {
+    struct newfs_inode_d  inode_d;
+    struct newfs_dentry*  dentry_cursor;
+    struct newfs_dentry_d dentry_d;
+    uint8_t*              blk_buf;
+    int ino             = inode->ino;
+    int dir_idx         = 0;
+    int blk_idx;
+    if (inode->is_corrupt) {                          /* 保留磁盘上的原始内容，只刷写已读入的子节点 */
+        for (dentry_cursor = inode->dentrys; dentry_cursor != NULL; dentry_cursor = dentry_cursor->brother) {
+            if (dentry_cursor->inode != NULL) {
+                newfs_sync_inode(dentry_cursor->inode);
+            }
+        }
+        return NEWFS_ERROR_NONE;
+    }
+    if (NEWFS_IS_REG(inode) && newfs_options.compress && !(inode->flags & NEWFS_INODE_COMPRESSED)) {
+        if (newfs_deflate(inode) != NEWFS_ERROR_NONE) {
+            NEWFS_ERR("[%s] io error\n", __func__);
+            return -NEWFS_ERROR_IO;
+        }
+    }
+                                                      /* Cycle 1: 写 数据 */
+    if (NEWFS_IS_DIR(inode)) {                          
+        dentry_cursor = inode->dentrys;
+        blk_buf       = (uint8_t *)malloc(NEWFS_BLKS_SZ());
+        while (dentry_cursor != NULL)                 /* 按块打包目录项，每块一次IO */
+        {
+            if (dir_idx % NEWFS_DENTRY_PER_BLK() == 0) {
+                memset(blk_buf, 0, NEWFS_BLKS_SZ());
+            }
+            memset(&dentry_d, 0, sizeof(struct newfs_dentry_d));
+            memcpy(dentry_d.fname, dentry_cursor->fname, NEWFS_MAX_FILE_NAME);
+            dentry_d.ftype = dentry_cursor->ftype;
+            dentry_d.ino = dentry_cursor->ino;
+            dentry_d.valid = 1;
+            memcpy(blk_buf + (dir_idx % NEWFS_DENTRY_PER_BLK()) * sizeof(struct newfs_dentry_d),
+                   &dentry_d, sizeof(struct newfs_dentry_d));
+            
+            if (dentry_cursor->inode != NULL) {
+                newfs_sync_inode(dentry_cursor->inode);
+            }
+
+            dentry_cursor = dentry_cursor->brother;
+            dir_idx++;
+            if (dir_idx % NEWFS_DENTRY_PER_BLK() == 0 || dentry_cursor == NULL) {
+                blk_idx = (dir_idx - 1) / NEWFS_DENTRY_PER_BLK();
+                                                      /* 目录块被去重共享时先换上私有块 */
+                if (newfs_cow_blocks(inode, blk_idx, blk_idx + 1) != NEWFS_ERROR_NONE) {
+                    free(blk_buf);
+                    return -NEWFS_ERROR_NOSPACE;
+                }
+                newfs_dedup_remove(inode->block_pointer[blk_idx]);
+                if (newfs_driver_write(NEWFS_DA_OFS(inode->block_pointer[blk_idx]), 
+                                       blk_buf, NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+                    NEWFS_ERR("[%s] io error\n", __func__);
+                    free(blk_buf);
+                    return -NEWFS_ERROR_IO;                     
+                }
+            }
+        }
+        free(blk_buf);
+    }
+    else if (NEWFS_IS_REG(inode) && !(inode->flags & NEWFS_INODE_COMPRESSED)) {
+        if (newfs_flush_data(inode) != NEWFS_ERROR_NONE) {
+            NEWFS_ERR("[%s] io error\n", __func__);
+            return -NEWFS_ERROR_IO;
+        }
+    }
+    if (inode->xattr_dirty && inode->xattr_blk >= 0) {/* xattr块被去重共享时先换上私有块 */
+        if (newfs_super.map_ref[inode->xattr_blk] > 0) {
+            blk_idx = newfs_data_alloc(-1, 1);
+            if (blk_idx < 0) {
+                return -NEWFS_ERROR_NOSPACE;
+            }
+            newfs_super.map_ref[inode->xattr_blk]--;
+            newfs_super.sz_usage += NEWFS_BLKS_SZ();
+            inode->xattr_blk = blk_idx;
+        }
+        newfs_dedup_remove(inode->xattr_blk);
+        if (newfs_driver_write(NEWFS_DA_OFS(inode->xattr_blk), inode->xattr_buf, 
+                               NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+            NEWFS_ERR("[%s] io error\n", __func__);
+            return -NEWFS_ERROR_IO;
+        }
+        inode->xattr_dirty = false;
+    }
+                                                      /* Cycle 2: 写 INODE，刷数据时的写时复制与去重会改变块号 */
+    memset(&inode_d, 0, sizeof(struct newfs_inode_d));
+    inode_d.ino         = ino;
+    inode_d.size        = inode->size;
+    inode_d.link        = 1;
+    inode_d.ftype       = inode->dentry->ftype;
+    inode_d.dir_cnt     = inode->dir_cnt;
+    memcpy(inode_d.block_pointer, inode->block_pointer, sizeof(inode_d.block_pointer));
+    inode_d.flags       = inode->flags;
+    inode_d.csize       = inode->csize;
+    inode_d.xattr_blk   = inode->xattr_blk;
+    memcpy(inode_d.xattr_inline, inode->xattr_inline, NEWFS_XATTR_INLINE_SZ);
+    if (newfs_driver_write(NEWFS_INO_OFS(ino), (uint8_t *)&inode_d, 
+                     sizeof(struct newfs_inode_d)) != NEWFS_ERROR_NONE) {
+        NEWFS_ERR("[%s] io error\n", __func__);
+        return -NEWFS_ERROR_IO;
+    }
+    return NEWFS_ERROR_NONE;
+}
+/**
+ * @brief 分配一个inode，占用位图
+ * 
+ * @param dentry 该dentry指向分配的inode
+ * @return newfs_inode 没有空闲inode时返回NULL
+ */
+struct newfs_inode* newfs_alloc_inode(struct newfs_dentry * dentry) {
+    struct newfs_inode* inode;
+    int ino_cursor = newfs_bitmap_alloc(newfs_super.map_inode, newfs_super.max_ino);
+
+    if (ino_cursor < 0)
+        return NULL;
+
+    inode = (struct newfs_inode*)malloc(sizeof(struct newfs_inode));
+    memset(inode, 0, sizeof(struct newfs_inode));
+    inode->ino  = ino_cursor; 
+    inode->size = 0;
+                                                      /* dentry指向inode */
+    dentry->inode = inode;
+    dentry->ino   = inode->ino;
+                                                      /* inode指回dentry */
+    inode->dentry = dentry;
+    
+    inode->dir_cnt = 0;
+    inode->dentrys = NULL;
+    memset(inode->block_pointer, -1, sizeof(inode->block_pointer));
+    inode->xattr_blk = -1;
+
+	if (NEWFS_IS_REG(inode)) {
+        inode->data = (uint8_t*)calloc(1, NEWFS_FILE_MAX_SZ());
+    }
+    else if (NEWFS_IS_DIR(inode)) {
+        inode->dentry_hash = (struct newfs_dentry**)calloc(NEWFS_DIR_HASH_SZ, sizeof(struct newfs_dentry*));
+    }
+    return inode;
+}
+/**
+ * @brief 释放内存中的inode子树，不修改位图也不写盘
+ * 
+ * @param inode 
+ */
+void newfs_release_inode(struct newfs_inode* inode) {
+    struct newfs_dentry* dentry_cursor = inode->dentrys;
+    struct newfs_dentry* next;
+    while (dentry_cursor != NULL) {
+        next = dentry_cursor->brother;
+        if (dentry_cursor->inode != NULL) {
+            newfs_release_inode(dentry_cursor->inode);
+        }
+        free(dentry_cursor);
+        dentry_cursor = next;
+    }
+    free(inode->dentry_hash);
+    free(inode->data);
+    free(inode->xattr_buf);
+    free(inode);
+}
+/**
+ * @brief 释放dentry指向的inode及其下方的整棵子树，归还inode位与数据块位
+ * 
+ * 未读入内存的子孙只读取其inode记录（目录还需读其目录项块），不读取文件数据，
+ * 递归删除时无需为每个节点建立完整的内存结构
+ * 
+ * @param dentry 已从父目录摘除的dentry
+ * @return int 
+ */
+int newfs_free_tree(struct newfs_dentry* dentry) {
+    struct newfs_inode*   inode = dentry->inode;
+    struct newfs_dentry*  dentry_cursor;
+    struct newfs_dentry*  next;
+    struct newfs_inode_d  inode_d;
+    struct newfs_dentry_d dentry_d;
+    struct newfs_dentry   child;
+
+    if (inode == NULL) {
+        if (newfs_super.map_iref[dentry->ino] > 0) {  /* 仍被快照引用，只去掉一个引用 */
+            newfs_super.map_iref[dentry->ino]--;
+            return NEWFS_ERROR_NONE;
+        }
+        if (newfs_driver_read(NEWFS_INO_OFS(dentry->ino), (uint8_t *)&inode_d, 
+                              sizeof(struct newfs_inode_d)) != NEWFS_ERROR_NONE) {
+            return -NEWFS_ERROR_IO;
+        }
+        if (inode_d.ftype == NEWFS_DIR) {
+            for (int i = 0; i < inode_d.dir_cnt; i++) {
+                int ofs = NEWFS_DA_OFS(inode_d.block_pointer[i / NEWFS_DENTRY_PER_BLK()]) + 
+                          (i % NEWFS_DENTRY_PER_BLK()) * sizeof(struct newfs_dentry_d);
+                if (newfs_driver_read(ofs, (uint8_t *)&dentry_d, 
+                                      sizeof(struct newfs_dentry_d)) != NEWFS_ERROR_NONE) {
+                    return -NEWFS_ERROR_IO;
+                }
+                memset(&child, 0, sizeof(struct newfs_dentry));
+                child.ino = dentry_d.ino;
+                newfs_free_tree(&child);
+            }
+        }
+        newfs_free_blocks(inode_d.block_pointer, 0, NEWFS_DATA_PER_FILE);
+        newfs_free_blocks(&inode_d.xattr_blk, 0, 1);
+        newfs_bitmap_free(newfs_super.map_inode, dentry->ino);
+        return NEWFS_ERROR_NONE;
+    }
+    if (newfs_super.map_iref[inode->ino] > 0) {       /* 换号失败的共享inode，磁盘内容仍归快照 */
+        newfs_super.map_iref[inode->ino]--;
+        newfs_release_inode(inode);
+        dentry->inode = NULL;
+        return NEWFS_ERROR_NONE;
+    }
+
+    if (NEWFS_IS_DIR(inode)) {
+        dentry_cursor = inode->dentrys;
+        while (dentry_cursor) {
+            next = dentry_cursor->brother;
+            newfs_free_tree(dentry_cursor);
+            free(dentry_cursor);
+            dentry_cursor = next;
+        }
+        free(inode->dentry_hash);
+    }
+    newfs_free_blocks(inode->block_pointer, 0, NEWFS_DATA_PER_FILE);
+    newfs_free_blocks(&inode->xattr_blk, 0, 1);
+    newfs_bitmap_free(newfs_super.map_inode, inode->ino);
+    if (inode->data != NULL) {
+        free(inode->data);
+    }
+    free(inode->xattr_buf);
+    free(inode);
+    dentry->inode = NULL;
+    return NEWFS_ERROR_NONE;
+}
+/**
+ * @brief 把与快照共享的inode换成私有副本：分配新inode号，新旧记录共享全部数据块与子inode，
+ * 引用数随之下推一层。内存中的inode会被修改并在刷盘时整体写回，因此在读入时就换号，
+ * 旧记录原样留给快照
+ * 
+ * @param inode 刚读入、仍使用共享inode号的inode
+ * @return int 0成功，否则-NEWFS_ERROR_NOSPACE
+ */
+int newfs_unshare_inode(struct newfs_inode* inode) {
+    struct newfs_dentry* child;
+    int ino;
+    for (int blk = 0; blk < NEWFS_DATA_PER_FILE; blk++) {
+        if (inode->block_pointer[blk] >= 0 && newfs_super.map_ref[inode->block_pointer[blk]] >= NEWFS_REF_MAX) {
+            return -NEWFS_ERROR_NOSPACE;
+        }
+    }
+    if (inode->xattr_blk >= 0 && newfs_super.map_ref[inode->xattr_blk] >= NEWFS_REF_MAX) {
+        return -NEWFS_ERROR_NOSPACE;
+    }
+    for (child = inode->dentrys; child != NULL; child = child->brother) {
+        if (newfs_super.map_iref[child->ino] >= NEWFS_IREF_MAX) {
+            return -NEWFS_ERROR_NOSPACE;
+        }
+    }
+    ino = newfs_bitmap_alloc(newfs_super.map_inode, newfs_super.max_ino);
+    if (ino < 0) {
+        return -NEWFS_ERROR_NOSPACE;
+    }
+    for (int blk = 0; blk < NEWFS_DATA_PER_FILE; blk++) {
+        if (inode->block_pointer[blk] >= 0) {
+            newfs_super.map_ref[inode->block_pointer[blk]]++;
+        }
+    }
+    if (inode->xattr_blk >= 0) {
+        newfs_super.map_ref[inode->xattr_blk]++;
+    }
+    for (child = inode->dentrys; child != NULL; child = child->brother) {
+        newfs_super.map_iref[child->ino]++;
+    }
+    newfs_super.map_iref[inode->ino]--;
+    inode->ino        = ino;
+    inode->dentry->ino = ino;                         /* 父目录刷盘时写出新inode号 */
+    return NEWFS_ERROR_NONE;
+}
+/**
+ * @brief 
+ * 
+ * @param dentry dentry指向ino，读取该inode
+ * @param ino inode唯一编号
+ * @return struct newfs_inode* 
+ */
+struct newfs_inode* newfs_read_inode(struct newfs_dentry * dentry, int ino) {
+    struct newfs_inode* inode = (struct newfs_inode*)malloc(sizeof(struct newfs_inode));
+    struct newfs_inode_d inode_d;
+    struct newfs_dentry* sub_dentry;
+    struct newfs_dentry_d dentry_d;
+    int    dir_cnt = 0, i;
+    memset(inode, 0, sizeof(struct newfs_inode));
+    if (newfs_driver_read(NEWFS_INO_OFS(ino), (uint8_t *)&inode_d, 
+                        sizeof(struct newfs_inode_d)) != NEWFS_ERROR_NONE) {
+        NEWFS_ERR("[%s] io error\n", __func__);
+        return NULL;                    
+    }
+    inode->dir_cnt = 0;
+    inode->ino = inode_d.ino;
+    inode->size = inode_d.size;
+    inode->dentry = dentry;
+    inode->dentrys = NULL;
+    memcpy(inode->block_pointer, inode_d.block_pointer, sizeof(inode->block_pointer));
+    inode->flags = inode_d.flags;
+    inode->csize = inode_d.csize;
+    inode->xattr_blk = inode_d.xattr_blk;
+    memcpy(inode->xattr_inline, inode_d.xattr_inline, NEWFS_XATTR_INLINE_SZ);
+    if (NEWFS_IS_DIR(inode)) {
+        inode->size = 0;                              /* 由newfs_alloc_dentry重新累加 */
+        inode->dentry_hash = (struct newfs_dentry**)calloc(NEWFS_DIR_HASH_SZ, sizeof(struct newfs_dentry*));
+        dir_cnt = inode_d.dir_cnt;
+        for (i = 0; i < dir_cnt; i++)
+        {
+            if (newfs_driver_read(NEWFS_DA_OFS(inode->block_pointer[i / NEWFS_DENTRY_PER_BLK()]) + 
+                                  (i % NEWFS_DENTRY_PER_BLK()) * sizeof(struct newfs_dentry_d), 
+                                (uint8_t *)&dentry_d, 
+                                sizeof(struct newfs_dentry_d)) != NEWFS_ERROR_NONE) {
+                NEWFS_ERR("[%s] io error\n", __func__);
+                inode->is_corrupt = true;
+                break;
+            }
+            sub_dentry = new_dentry(dentry_d.fname, dentry_d.ftype);
+            sub_dentry->parent = inode->dentry;
+            sub_dentry->ino    = dentry_d.ino; 
+            newfs_alloc_dentry(inode, sub_dentry);
+        }
+    }
+    else if (NEWFS_IS_REG(inode)) {
+        inode->data = (uint8_t *)calloc(1, NEWFS_FILE_MAX_SZ());
+        if (inode->flags & NEWFS_INODE_COMPRESSED) {  /* 读入压缩extent后解压 */
+            uint8_t* cbuf = (uint8_t *)malloc(NEWFS_FILE_MAX_SZ());
+            if (newfs_transfer_data(inode, cbuf, false) != NEWFS_ERROR_NONE ||
+                inode->csize > NEWFS_FILE_MAX_SZ() ||
+                newfs_decompress(cbuf, inode->csize, inode->data, inode->size) != inode->size) {
+                NEWFS_ERR("[%s] io error\n", __func__);
+                memset(inode->data, 0, NEWFS_FILE_MAX_SZ());
+                inode->is_corrupt = true;
+            }
+            free(cbuf);
+        }
+        else if (newfs_transfer_data(inode, inode->data, false) != NEWFS_ERROR_NONE) {
+            NEWFS_ERR("[%s] io error\n", __func__);
+            inode->is_corrupt = true;
+        }
+    }
+    if (newfs_super.map_iref[ino] > 0 && !newfs_super.read_only && !inode->is_corrupt &&
+        newfs_unshare_inode(inode) != NEWFS_ERROR_NONE) {
+        NEWFS_ERR("[%s] cannot unshare inode %d from snapshot, keeping it read-only\n", __func__, ino);
+        inode->is_corrupt = true;                     /* 不刷回，保护快照中的内容 */
+    }
+    return inode;
+}
+/**
+ * @brief 
+ * path: /qwe/ad  total_lvl = 2,
+ *      1) find /'s inode       lvl = 1
+ *      2) find qwe's dentry 
+ *      3) find qwe's inode     lvl = 2
+ *      4) find ad's dentry
+ *
+ * path: /qwe     total_lvl = 1,
+ *      1) find /'s inode       lvl = 1
+ *      2) find qwe's dentry
+ * 
+ * @param path 
+ * @return struct newfs_inode* 
+ */
+static struct newfs_dentry* newfs_lookup_walk(const char * path, bool* is_find, bool* is_root) {
+    struct newfs_dentry* dentry_cursor = newfs_super.root_dentry;
+    struct newfs_dentry* dentry_ret = NULL;
+    struct newfs_inode*  inode; 
+    int   total_lvl = newfs_calc_lvl(path);
+    int   lvl = 0;
+    char* fname = NULL;
+    char* path_cpy = (char*)malloc(strlen(path) + 1);
+    *is_find = false;
+    *is_root = false;
+    strcpy(path_cpy, path);
+
+    if (total_lvl == 0) {                           /* 根目录 */
+        *is_find = true;
+        *is_root = true;
+        dentry_ret = newfs_super.root_dentry;
+    }
+    fname = strtok(path_cpy, "/");       
+    while (fname)
+    {   
+        lvl++;
+        if (dentry_cursor->inode == NULL) {           /* Cache机制 */
+            NEWFS_STAT(icache_miss, 1);
+            dentry_cursor->inode = newfs_read_inode(dentry_cursor, dentry_cursor->ino);
+        }
+        else {
+            NEWFS_STAT(icache_hit, 1);
+        }
+
+        inode = dentry_cursor->inode;
+
+        if (NEWFS_IS_REG(inode)) {                    /* 路径中间出现普通文件 */
+            NEWFS_DBG("[%s] not a dir\n", __func__);
+            dentry_ret = inode->dentry;
+            break;
+        }
+        if (NEWFS_IS_DIR(inode)) {
+            dentry_cursor = newfs_find_dentry(inode, fname);
+            
+            if (dentry_cursor == NULL) {
+                *is_find = false;
+                NEWFS_DBG("[%s] not found %s\n", __func__, fname);
+                dentry_ret = inode->dentry;
+                break;
+            }
+
+            if (lvl == total_lvl) {
+                *is_find = true;
+                dentry_ret = dentry_cursor;
+                break;
+            }
+        }
+        fname = strtok(NULL, "/"); 
+    }
+
+    if (dentry_ret->inode == NULL) {
+        NEWFS_STAT(icache_miss, 1);
+        dentry_ret->inode = newfs_read_inode(dentry_ret, dentry_ret->ino);
+    }
+    else if (*is_find && !*is_root) {
+        NEWFS_STAT(icache_hit, 1);
+    }
+    
+    free(path_cpy);
+    return dentry_ret;
+}
+/**
+ * @brief 查找路径对应的dentry，并计入lookup延迟统计
+ * 
+ * @param path 
+ * @param is_find 
+ * @param is_root 
+ * @return struct newfs_dentry* 
+ */
+struct newfs_dentry* newfs_lookup(const char * path, bool* is_find, bool* is_root) {
+    uint64_t             start  = newfs_stats_now();
+    struct newfs_dentry* dentry = newfs_lookup_walk(path, is_find, is_root);
+    newfs_stats_op(NEWFS_OP_LOOKUP, start);
+    return dentry;
+}
+/******************************************************************************
+* SECTION: 检查点与快照
+*
+* 快照是根目录inode的一份拷贝：与活动根共享目录项块，并把根下每个子inode的
+* 共享计数（IRef Map）加一。活动树在读入共享inode时换成私有inode号（见
+* newfs_unshare_inode），数据块沿用已有的引用计数写时复制，因此创建快照只需一次
+* 检查点加O(1)的元数据写入，快照中的内容此后不再被改写。
+*******************************************************************************/
+/**
+ * @brief 由内存超级块填写磁盘超级块
+ * 
+ * @param newfs_super_d 
+ */
+void newfs_fill_super_d(struct newfs_super_d* newfs_super_d) {
+    memset(newfs_super_d, 0, sizeof(struct newfs_super_d));
+    newfs_super_d->magic_num           = NEWFS_MAGIC_NUM;
+    newfs_super_d->max_ino             = newfs_super.max_ino;
+    newfs_super_d->max_data            = newfs_super.max_data;
+    newfs_super_d->map_inode_blks      = newfs_super.map_inode_blks;
+    newfs_super_d->map_inode_offset    = newfs_super.map_inode_offset;
+    newfs_super_d->map_data_blks      = newfs_super.map_data_blks;
+    newfs_super_d->map_data_offset      = newfs_super.map_data_offset;
+    newfs_super_d->map_ref_blks        = newfs_super.map_ref_blks;
+    newfs_super_d->map_ref_offset      = newfs_super.map_ref_offset;
+    newfs_super_d->map_csum_blks       = newfs_super.map_csum_blks;
+    newfs_super_d->map_csum_offset     = newfs_super.map_csum_offset;
+    newfs_super_d->map_iref_blks       = newfs_super.map_iref_blks;
+    newfs_super_d->map_iref_offset     = newfs_super.map_iref_offset;
+    newfs_super_d->inode_offset         = newfs_super.inode_offset;
+    newfs_super_d->data_offset         = newfs_super.data_offset;
+    newfs_super_d->sz_usage            = newfs_super.sz_usage;
+    memcpy(newfs_super_d->snaps, newfs_super.snaps, sizeof(newfs_super_d->snaps));
+}
+/**
+ * @brief 写回各位图/计数表与超级块。超级块最后写，扩容迁移表时中途失败不会指向未写完的表
+ * 
+ * @return int 0成功，否则-NEWFS_ERROR_IO
+ */
+int newfs_write_super(void) {
+    struct newfs_super_d newfs_super_d;
+
+    newfs_fill_super_d(&newfs_super_d);
+
+    if (newfs_driver_write(newfs_super_d.map_inode_offset, (uint8_t *)(newfs_super.map_inode), 
+                        newfs_super_d.map_inode_blks * NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+
+    if (newfs_driver_write(newfs_super_d.map_data_offset, (uint8_t *)(newfs_super.map_data), 
+                        newfs_super_d.map_data_blks * NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+
+    if (newfs_driver_write(newfs_super_d.map_ref_offset, (uint8_t *)(newfs_super.map_ref), 
+                        newfs_super_d.map_ref_blks * NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+
+    if (newfs_driver_write(newfs_super_d.map_csum_offset, (uint8_t *)(newfs_super.map_csum), 
+                        newfs_super_d.map_csum_blks * NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+
+    if (newfs_driver_write(newfs_super_d.map_iref_offset, (uint8_t *)(newfs_super.map_iref), 
+                        newfs_super_d.map_iref_blks * NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+
+    if (newfs_driver_write(NEWFS_SUPER_OFS, (uint8_t *)&newfs_super_d, 
+                     sizeof(struct newfs_super_d)) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+    return NEWFS_ERROR_NONE;
+}
+/**
+ * @brief 把表扩展到blks块，新增部分清零
+ * 
+ * @param map 
+ * @param old_blks 
+ * @param blks 
+ * @return void* 
+ */
+static void* newfs_grow_map(void* map, int old_blks, int blks) {
+    map = realloc(map, blks * NEWFS_BLKS_SZ());
+    memset((uint8_t *)map + old_blks * NEWFS_BLKS_SZ(), 0, (blks - old_blks) * NEWFS_BLKS_SZ());
+    return map;
+}
+/**
+ * @brief 在线扩容：数据区延伸到新的磁盘末尾，必要时把按数据块索引的表迁到末尾，
+ * 已有数据块不移动，只写回表与超级块
+ * 
+ * @param sz_disk 新的磁盘大小，不能超过驱动报告的设备大小
+ * @return int 0成功，否则失败
+ */
+int newfs_grow(long sz_disk) {
+    struct newfs_super_d layout;
+    int    dev_sz, old_max = newfs_super.max_data, ret;
+
+    ddriver_ioctl(NEWFS_DRIVER(), IOC_REQ_DEVICE_SIZE, &dev_sz);
+    if (sz_disk > dev_sz) {
+        NEWFS_ERR("[%s] device is %d bytes, cannot grow to %ld\n", __func__, dev_sz, sz_disk);
+        return -NEWFS_ERROR_NOSPACE;
+    }
+    newfs_fill_super_d(&layout);
+    ret = newfs_layout_grow(&layout, sz_disk);
+    if (ret != NEWFS_ERROR_NONE) {
+        return ret;
+    }
+
+    if (newfs_options.scrub_rate > 0) {               /* 后台校验会读位图，换表期间先停下 */
+        newfs_super.scrub_stop = true;
+        pthread_join(newfs_super.scrub_thread, NULL);
+    }
+    pthread_mutex_lock(&newfs_super.driver_lock);     /* 与校验和表的读写互斥 */
+    newfs_super.map_data = newfs_grow_map(newfs_super.map_data, newfs_super.map_data_blks, layout.map_data_blks);
+    newfs_super.map_unwritten = newfs_grow_map(newfs_super.map_unwritten, newfs_super.map_data_blks, layout.map_data_blks);
+    newfs_super.map_ref  = newfs_grow_map(newfs_super.map_ref, newfs_super.map_ref_blks, layout.map_ref_blks);
+    newfs_super.map_csum = newfs_grow_map(newfs_super.map_csum, newfs_super.map_csum_blks, layout.map_csum_blks);
+    newfs_super.map_data_blks   = layout.map_data_blks;
+    newfs_super.map_data_offset = layout.map_data_offset;
+    newfs_super.map_ref_blks    = layout.map_ref_blks;
+    newfs_super.map_ref_offset  = layout.map_ref_offset;
+    newfs_super.map_csum_blks   = layout.map_csum_blks;
+    newfs_super.map_csum_offset = layout.map_csum_offset;
+    newfs_super.max_data        = layout.max_data;
+    newfs_super.sz_disk         = (int)sz_disk;
+    pthread_mutex_unlock(&newfs_super.driver_lock);
+    if (newfs_super.dedup_nodes != NULL) {
+        newfs_super.dedup_nodes = realloc(newfs_super.dedup_nodes, 
+                                          newfs_super.max_data * sizeof(struct newfs_dedup_node));
+        memset(newfs_super.dedup_nodes + old_max, 0, 
+               (newfs_super.max_data - old_max) * sizeof(struct newfs_dedup_node));
+    }
+    if (newfs_options.scrub_rate > 0) {
+        newfs_super.scrub_stop = false;
+        pthread_create(&newfs_super.scrub_thread, NULL, newfs_scrub_worker, &newfs_options.scrub_rate);
+    }
+
+    NEWFS_INFO("grown to %ld bytes, %d data blocks, data maps at %d\n", 
+               sz_disk, newfs_super.max_data, newfs_super.map_data_offset);
+    return newfs_write_super();
+}
+/**
+ * @brief 检查点：从根节点向下刷写所有inode，再写回超级块与位图
+ * 
+ * @return int 0成功，否则失败
+ */
+int newfs_checkpoint(void) {
+    int ret = newfs_sync_inode(newfs_super.root_dentry->inode);
+    if (ret != NEWFS_ERROR_NONE) {
+        return ret;
+    }
+    return newfs_write_super();
+}
+/**
+ * @brief 按名字查找快照
+ * 
+ * @param name 
+ * @return int 快照表下标，不存在返回-1
+ */
+int newfs_snap_find(const char* name) {
+    for (int slot = 0; slot < NEWFS_SNAP_MAX; slot++) {
+        if (newfs_super.snaps[slot].ino != 0 && 
+            strncmp(newfs_super.snaps[slot].name, name, NEWFS_SNAP_NAME) == 0) {
+            return slot;
+        }
+    }
+    return -1;
+}
+/**
+ * @brief 创建快照：检查点后复制根inode记录，根下的子inode与数据块全部共享
+ * 
+ * @param name 快照名
+ * @return int 0成功，否则失败
+ */
+int newfs_snap_create(const char* name) {
+    struct newfs_inode*  root = newfs_super.root_dentry->inode;
+    struct newfs_dentry* child;
+    struct newfs_inode_d inode_d;
+    int slot = -1, ino, ret;
+
+    if (strlen(name) == 0 || strlen(name) >= NEWFS_SNAP_NAME) {
+        return -NEWFS_ERROR_INVAL;
+    }
+    if (newfs_snap_find(name) >= 0) {
+        return -NEWFS_ERROR_EXISTS;
+    }
+    for (int i = 0; i < NEWFS_SNAP_MAX && slot < 0; i++) {
+        if (newfs_super.snaps[i].ino == 0) {
+            slot = i;
+        }
+    }
+    if (slot < 0 || root->is_corrupt) {
+        return slot < 0 ? -NEWFS_ERROR_NOSPACE : -NEWFS_ERROR_IO;
+    }
+
+    ret = newfs_checkpoint();                         /* 磁盘上的根记录即快照内容 */
+    if (ret != NEWFS_ERROR_NONE) {
+        return ret;
+    }
+    if (newfs_driver_read(NEWFS_INO_OFS(root->ino), (uint8_t *)&inode_d, 
+                          sizeof(struct newfs_inode_d)) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+    for (int blk = 0; blk < NEWFS_DATA_PER_FILE; blk++) {
+        if (inode_d.block_pointer[blk] >= 0 && newfs_super.map_ref[inode_d.block_pointer[blk]] >= NEWFS_REF_MAX) {
+            return -NEWFS_ERROR_NOSPACE;
+        }
+    }
+    if (inode_d.xattr_blk >= 0 && newfs_super.map_ref[inode_d.xattr_blk] >= NEWFS_REF_MAX) {
+        return -NEWFS_ERROR_NOSPACE;
+    }
+    for (child = root->dentrys; child != NULL; child = child->brother) {
+        if (newfs_super.map_iref[child->ino] >= NEWFS_IREF_MAX) {
+            return -NEWFS_ERROR_NOSPACE;
+        }
+    }
+    ino = newfs_bitmap_alloc(newfs_super.map_inode, newfs_super.max_ino);
+    if (ino < 0) {
+        return -NEWFS_ERROR_NOSPACE;
+    }
+
+    for (int blk = 0; blk < NEWFS_DATA_PER_FILE; blk++) {
+        if (inode_d.block_pointer[blk] >= 0) {
+            newfs_super.map_ref[inode_d.block_pointer[blk]]++;
+        }
+    }
+    if (inode_d.xattr_blk >= 0) {
+        newfs_super.map_ref[inode_d.xattr_blk]++;
+    }
+    inode_d.ino = ino;
+    if (newfs_driver_write(NEWFS_INO_OFS(ino), (uint8_t *)&inode_d, 
+                           sizeof(struct newfs_inode_d)) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+    for (child = root->dentrys; child != NULL; child = child->brother) {
+        newfs_super.map_iref[child->ino]++;
+        if (child->inode != NULL) {                   /* 已读入的子树都已刷盘，释放后按需重读并换号 */
+            newfs_release_inode(child->inode);
+            child->inode = NULL;
+        }
+    }
+    memset(&newfs_super.snaps[slot], 0, sizeof(struct newfs_snap_d));
+    strncpy(newfs_super.snaps[slot].name, name, NEWFS_SNAP_NAME - 1);
+    newfs_super.snaps[slot].ino = ino;
+    NEWFS_INFO("snapshot %s created, root inode %d\n", name, ino);
+    return newfs_write_super();
+}
+/**
+ * @brief 删除快照：只有快照独占的inode与数据块会被释放
+ * 
+ * @param name 快照名
+ * @return int 0成功，否则失败
+ */
+int newfs_snap_delete(const char* name) {
+    struct newfs_dentry snap_root;
+    int slot = newfs_snap_find(name);
+    int ret;
+
+    if (slot < 0) {
+        return -NEWFS_ERROR_NOTFOUND;
+    }
+    memset(&snap_root, 0, sizeof(struct newfs_dentry));
+    snap_root.ino = newfs_super.snaps[slot].ino;
+    ret = newfs_free_tree(&snap_root);
+    if (ret != NEWFS_ERROR_NONE) {
+        return ret;
+    }
+    memset(&newfs_super.snaps[slot], 0, sizeof(struct newfs_snap_d));
+    NEWFS_INFO("snapshot %s deleted\n", name);
+    return newfs_write_super();
+}
+/**
+ * @brief 判断路径是否位于虚拟快照目录下
+ * 
+ * @param path 
+ * @param name 返回快照名
+ * @return int 0不是，1为快照目录本身，2为/.snapshots/NAME，3为更深的路径
+ */
+static int newfs_snap_path(const char* path, const char** name) {
+    size_t len = strlen(NEWFS_SNAP_PATH);
+    if (strncmp(path, NEWFS_SNAP_PATH, len) != 0 || (path[len] != '\0' && path[len] != '/')) {
+        return 0;
+    }
+    if (path[len] == '\0' || path[len + 1] == '\0') {
+        return 1;
+    }
+    *name = path + len + 1;
+    return strchr(*name, '/') == NULL ? 2 : 3;
+}
+/**
+ * @brief 挂载（mount）文件系统
+ * 
+ * @param conn_info 可忽略，一些建立连接相关的信息 
+ * @return void*
+ */
+void* newfs_init(struct fuse_conn_info * conn_info) {
+	/* TODO: 在这里进行挂载 */
+
 	/*定义磁盘各部分结构*/
     int                   driver_fd;
     struct newfs_super_d  newfs_super_d; 
@@ -435,6 +1670,11 @@ void* newfs_init(struct fuse_conn_info * conn_info) {
     struct newfs_inode*   root_inode;
     bool                  is_init = false;
 
+	/*启动日志线程，FUSE已完成后台化*/
+	if (newfs_log_start(newfs_options.log_file, newfs_options.log_level) != NEWFS_ERROR_NONE) {
+		NEWFS_WARN("[%s] cannot open log file %s, using stderr\n", __func__, newfs_options.log_file);
+	}
+
 	/*打开驱动*/
 	driver_fd = ddriver_open(newfs_options.device);
 
@@ -446,6 +1686,8 @@ void* newfs_init(struct fuse_conn_info * conn_info) {
 	int sz_io;
 
 	newfs_super.driver_fd = driver_fd;
+    pthread_mutex_init(&newfs_super.driver_lock, NULL);
+    newfs_crc32c_init();
     ddriver_ioctl(newfs_super.driver_fd, IOC_REQ_DEVICE_SIZE,  &newfs_super.sz_disk);
     ddriver_ioctl(newfs_super.driver_fd, IOC_REQ_DEVICE_IO_SZ, &newfs_super.sz_io);
 
@@ -457,21 +1699,37 @@ void* newfs_init(struct fuse_conn_info * conn_info) {
         return -NEWFS_ERROR_IO;
     }
 
+	if (newfs_super_d.magic_num == NEWFS_MAGIC_NUM_V1) {  /* 旧布局的镜像，拒绝挂载，不覆盖。main已在挂载前检查 */
+        NEWFS_ERR("[%s] %s has the old newfs layout, reformat it to mount\n", __func__, newfs_options.device);
+        exit(EXIT_FAILURE);
+    }
 	if (newfs_super_d.magic_num != NEWFS_MAGIC_NUM) {     /* 幻数无 */
-        newfs_super.max_ino = NEWFS_INODE_NUM; 
-        newfs_super.max_data = NEWFS_DATA_NUM; 
+        newfs_super_d.max_ino = NEWFS_INODE_NUM; 
+        newfs_super_d.max_data = NEWFS_DATA_NUM; 
         newfs_super_d.map_inode_offset = NEWFS_MAP_INODE_OFS;
         newfs_super_d.map_data_offset = NEWFS_MAP_DATA_OFS;
+        newfs_super_d.map_ref_offset = NEWFS_MAP_REF_OFS;
+        newfs_super_d.map_ref_blks  = NEWFS_MAP_REF_BLOCKS;
+        newfs_super_d.map_csum_offset = NEWFS_MAP_CSUM_OFS;
+        newfs_super_d.map_csum_blks  = NEWFS_MAP_CSUM_BLOCKS;
+        newfs_super_d.map_iref_offset = NEWFS_MAP_IREF_OFS;
+        newfs_super_d.map_iref_blks  = NEWFS_MAP_IREF_BLOCKS;
         newfs_super_d.map_inode_blks  = NEWFS_MAP_INODE_BLOCKS;
 		newfs_super_d.map_data_blks  = NEWFS_MAP_DATA_BLOCKS;
 		newfs_super_d.inode_offset = NEWFS_INODE_OFS;
 		newfs_super_d.data_offset = NEWFS_DATA_OFS;
 		newfs_super_d.sz_usage  = 0;
-		NEWFS_DBG("inode map blocks: %d\n", newfs_super_d.map_inode_blks);
+		memset(newfs_super_d.snaps, 0, sizeof(newfs_super_d.snaps));
+		NEWFS_INFO("format: inode map blocks: %d\n", newfs_super_d.map_inode_blks);
         is_init = true;
     }
 
 	newfs_super.sz_usage   = newfs_super_d.sz_usage;      /* 建立 in-memory 结构 */
+    newfs_super.max_ino    = newfs_super_d.max_ino;
+    newfs_super.max_data   = newfs_super_d.max_data;
+    newfs_super.inode_offset = newfs_super_d.inode_offset;
+    newfs_super.data_offset  = newfs_super_d.data_offset;
+    memcpy(newfs_super.snaps, newfs_super_d.snaps, sizeof(newfs_super.snaps));
 
 	newfs_super.map_inode = (uint8_t *)malloc(newfs_super_d.map_inode_blks * NEWFS_BLKS_SZ()); // 给文件系统inode位图分配空间
     newfs_super.map_inode_blks = newfs_super_d.map_inode_blks;
@@ -480,6 +1738,19 @@ void* newfs_init(struct fuse_conn_info * conn_info) {
 	newfs_super.map_data = (uint8_t *)malloc(newfs_super_d.map_data_blks * NEWFS_BLKS_SZ()); // 给文件系统data位图分配空间
     newfs_super.map_data_blks = newfs_super_d.map_data_blks;
     newfs_super.map_data_offset = newfs_super_d.map_data_offset;
+    newfs_super.map_unwritten = (uint8_t *)calloc(newfs_super_d.map_data_blks, NEWFS_BLKS_SZ());  // 挂载时磁盘上已分配的块都写过
+
+	newfs_super.map_ref = (uint8_t *)malloc(newfs_super_d.map_ref_blks * NEWFS_BLKS_SZ()); // 给数据块引用计数表分配空间
+    newfs_super.map_ref_blks = newfs_super_d.map_ref_blks;
+    newfs_super.map_ref_offset = newfs_super_d.map_ref_offset;
+
+	newfs_super.map_csum = (uint32_t *)malloc(newfs_super_d.map_csum_blks * NEWFS_BLKS_SZ()); // 给数据块校验和表分配空间
+    newfs_super.map_csum_blks = newfs_super_d.map_csum_blks;
+    newfs_super.map_csum_offset = newfs_super_d.map_csum_offset;
+
+	newfs_super.map_iref = (uint8_t *)malloc(newfs_super_d.map_iref_blks * NEWFS_BLKS_SZ()); // 给inode共享计数表分配空间
+    newfs_super.map_iref_blks = newfs_super_d.map_iref_blks;
+    newfs_super.map_iref_offset = newfs_super_d.map_iref_offset;
 
 	if (newfs_driver_read(newfs_super_d.map_inode_offset, (uint8_t *)(newfs_super.map_inode),  // 读取磁盘inode位图给文件系统inode位图
                         newfs_super_d.map_inode_blks * NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
@@ -491,16 +1762,60 @@ void* newfs_init(struct fuse_conn_info * conn_info) {
         return -NEWFS_ERROR_IO;
     }
 
+	if (newfs_driver_read(newfs_super_d.map_ref_offset, (uint8_t *)(newfs_super.map_ref),      // 读取磁盘引用计数表
+                        newfs_super_d.map_ref_blks * NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+
+	if (newfs_driver_read(newfs_super_d.map_csum_offset, (uint8_t *)(newfs_super.map_csum),    // 读取磁盘校验和表
+                        newfs_super_d.map_csum_blks * NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+
+	if (newfs_driver_read(newfs_super_d.map_iref_offset, (uint8_t *)(newfs_super.map_iref),    // 读取磁盘inode共享计数表
+                        newfs_super_d.map_iref_blks * NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+
+    if (newfs_options.dedup) {                        /* 校验和表即持久化的指纹表，据此重建内存索引 */
+        newfs_super.dedup_head  = (int *)malloc(NEWFS_DEDUP_BUCKETS * sizeof(int));
+        newfs_super.dedup_nodes = (struct newfs_dedup_node *)calloc(newfs_super.max_data, 
+                                                                    sizeof(struct newfs_dedup_node));
+        memset(newfs_super.dedup_head, -1, NEWFS_DEDUP_BUCKETS * sizeof(int));
+        for (int blk = 0; blk < newfs_super.max_data; blk++) {
+            if (newfs_super.map_data[blk / UINT8_BITS] & (0x1 << (blk % UINT8_BITS))) {
+                newfs_dedup_insert(blk, newfs_super.map_csum[blk]);
+            }
+        }
+    }
+
 	if (is_init) {                                    /* 若尚未初始化，分配根节点 */
         root_inode = newfs_alloc_inode(root_dentry); // 为根目录项分配inode
         newfs_sync_inode(root_inode);                // 将根目录inode下的文件结构刷回磁盘
     }
 
-    root_inode            = newfs_read_inode(root_dentry, 0); // 读取根节点
+    int root_ino = 0;
+    newfs_super.read_only = false;
+    if (newfs_options.snapshot != NULL) {             /* 以只读方式挂载快照 */
+        int slot = newfs_snap_find(newfs_options.snapshot);
+        if (slot < 0) {
+            NEWFS_ERR("[%s] snapshot %s not found\n", __func__, newfs_options.snapshot);
+            exit(EXIT_FAILURE);                       /* main已在挂载前检查，返回值会被当作私有数据 */
+        }
+        root_ino               = newfs_super.snaps[slot].ino;
+        newfs_super.read_only  = true;
+    }
+
+    root_inode            = newfs_read_inode(root_dentry, root_ino); // 读取根节点
     root_dentry->inode    = root_inode;                       // 连接根目录和根节点
     newfs_super.root_dentry = root_dentry;                    
     newfs_super.is_mounted  = true;
 
+    newfs_super.scrub_stop  = false;
+    if (newfs_options.scrub_rate > 0) {               /* 启动后台校验 */
+        pthread_create(&newfs_super.scrub_thread, NULL, newfs_scrub_worker, &newfs_options.scrub_rate);
+    }
+
     return NULL;
 }
 
@@ -512,41 +1827,39 @@ void* newfs_init(struct fuse_conn_info * conn_info) {
  */
 void newfs_destroy(void* p) {
 	/* TODO: 在这里进行卸载 */
-	struct newfs_super_d  newfs_super_d; 
+    uint64_t              sync_start;
 
     if (!newfs_super.is_mounted) {
         return NEWFS_ERROR_NONE;
     }
 
-    newfs_sync_inode(newfs_super.root_dentry->inode);     /* 从根节点向下刷写节点 */
-                                                    
-    newfs_super_d.magic_num           = NEWFS_MAGIC_NUM;
-    newfs_super_d.map_inode_blks      = newfs_super.map_inode_blks;
-    newfs_super_d.map_inode_offset    = newfs_super.map_inode_offset;
-    newfs_super_d.map_data_blks      = newfs_super.map_data_blks;
-    newfs_super_d.map_data_offset      = newfs_super.map_data_offset;
-    newfs_super_d.inode_offset         = newfs_super.inode_offset;
-    newfs_super_d.data_offset         = newfs_super.data_offset;
-    newfs_super_d.sz_usage            = newfs_super.sz_usage;
-
-    if (newfs_driver_write(NEWFS_SUPER_OFS, (uint8_t *)&newfs_super_d, 
-                     sizeof(struct newfs_super_d)) != NEWFS_ERROR_NONE) {
-        return -NEWFS_ERROR_IO;
-    }
-
-    if (newfs_driver_write(newfs_super_d.map_inode_offset, (uint8_t *)(newfs_super.map_inode), 
-                        newfs_super_d.map_inode_blks * NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
-        return -NEWFS_ERROR_IO;
+    if (newfs_options.scrub_rate > 0) {
+        newfs_super.scrub_stop = true;
+        pthread_join(newfs_super.scrub_thread, NULL);
     }
 
-    if (newfs_driver_write(newfs_super_d.map_data_offset, (uint8_t *)(newfs_super.map_data), 
-                        newfs_super_d.map_data_blks * NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
-        return -NEWFS_ERROR_IO;
+    if (!newfs_super.read_only) {
+        sync_start = newfs_stats_now();
+        newfs_checkpoint();
+        newfs_stats_op(NEWFS_OP_SYNC, sync_start);
     }
 
     free(newfs_super.map_inode);
     free(newfs_super.map_data);
+    free(newfs_super.map_unwritten);
+    free(newfs_super.map_ref);
+    free(newfs_super.map_csum);
+    free(newfs_super.map_iref);
+    newfs_super.map_csum = NULL;
+    newfs_super.map_unwritten = NULL;
+    newfs_super.map_iref = NULL;
+    free(newfs_super.dedup_head);
+    free(newfs_super.dedup_nodes);
+    newfs_super.dedup_head  = NULL;
+    newfs_super.dedup_nodes = NULL;
     ddriver_close(NEWFS_DRIVER());
+    newfs_super.is_mounted = false;                   /* 之后挂载失败时不会再写回 */
+    newfs_log_stop_drain();
 	return;
 }
 
@@ -564,11 +1877,28 @@ int newfs_mkdir(const char* path, mode_t mode) {
     struct newfs_dentry* last_dentry = newfs_lookup(path, &is_find, &is_root);//寻找上级目录项
     struct newfs_dentry* dentry;
     struct newfs_inode*  inode;
+    const char* snap_name;
+    int   snap = newfs_snap_path(path, &snap_name);
+
+    if (snap == 2) {                                  /* mkdir /.snapshots/NAME 即创建快照 */
+        return newfs_super.read_only ? -NEWFS_ERROR_ROFS : newfs_snap_create(snap_name);
+    }
+    if (snap == 3) {
+        return -NEWFS_ERROR_ACCESS;
+    }
 
-    if (is_find) {//目录存在
+    if (is_find || snap == 1 || strcmp(path, NEWFS_STATS_PATH) == 0) {//目录存在
         return -NEWFS_ERROR_EXISTS;
     }
 
+    if (newfs_super.read_only) {
+        return -NEWFS_ERROR_ROFS;
+    }
+
+    if (last_dentry->inode->is_corrupt) {
+        return -NEWFS_ERROR_IO;
+    }
+
     if (NEWFS_IS_REG(last_dentry->inode)) {
         return -NEWFS_ERROR_UNSUPPORTED;
     }
@@ -577,7 +1907,15 @@ int newfs_mkdir(const char* path, mode_t mode) {
     dentry = new_dentry(fname, NEWFS_DIR); 
     dentry->parent = last_dentry;
     inode  = newfs_alloc_inode(dentry);
-    newfs_alloc_dentry(last_dentry->inode, dentry);
+    if (inode == NULL) {
+        free(dentry);
+        return -NEWFS_ERROR_NOSPACE;
+    }
+    if (newfs_alloc_dentry(last_dentry->inode, dentry) < 0) {
+        newfs_free_tree(dentry);
+        free(dentry);
+        return -NEWFS_ERROR_NOSPACE;
+    }
 
     return NEWFS_ERROR_NONE;
 }
@@ -592,7 +1930,39 @@ int newfs_mkdir(const char* path, mode_t mode) {
 int newfs_getattr(const char* path, struct stat * newfs_stat) {
 	/* TODO: 解析路径，获取Inode，填充newfs_stat，可参考/fs/simplefs/sfs.c的sfs_getattr()函数实现 */
 	bool	is_find, is_root;
-	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
+	struct newfs_dentry* dentry;
+	char*  stats_buf;
+	int    stats_len;
+	const char* snap_name;
+	int    snap = newfs_snap_path(path, &snap_name);
+
+	if (strcmp(path, NEWFS_STATS_PATH) == 0) {        /* 虚拟统计文件，不占inode */
+		stats_buf = newfs_stats_text(&stats_len);
+		free(stats_buf);
+		memset(newfs_stat, 0, sizeof(struct stat));
+		newfs_stat->st_mode  = S_IFREG | 0444;
+		newfs_stat->st_size  = stats_len;
+		newfs_stat->st_nlink = 1;
+		newfs_stat->st_uid   = getuid();
+		newfs_stat->st_gid   = getgid();
+		newfs_stat->st_mtime = time(NULL);
+		return NEWFS_ERROR_NONE;
+	}
+
+	if (snap != 0) {                                  /* 虚拟快照目录及其下的各快照 */
+		if (snap == 3 || (snap == 2 && newfs_snap_find(snap_name) < 0)) {
+			return -NEWFS_ERROR_NOTFOUND;
+		}
+		memset(newfs_stat, 0, sizeof(struct stat));
+		newfs_stat->st_mode  = S_IFDIR | 0555;
+		newfs_stat->st_nlink = 2;
+		newfs_stat->st_uid   = getuid();
+		newfs_stat->st_gid   = getgid();
+		newfs_stat->st_mtime = time(NULL);
+		return NEWFS_ERROR_NONE;
+	}
+
+	dentry = newfs_lookup(path, &is_find, &is_root);
 	if (is_find == false) {
 		return -NEWFS_ERROR_NOTFOUND;
 	}
@@ -604,6 +1974,12 @@ int newfs_getattr(const char* path, struct stat * newfs_stat) {
 	else if (NEWFS_IS_REG(dentry->inode)) {
 		newfs_stat->st_mode = S_IFREG | NEWFS_DEFAULT_PERM;
 		newfs_stat->st_size = dentry->inode->size;
+		newfs_stat->st_blocks = 0;
+		for (int blk = 0; blk < NEWFS_DATA_PER_FILE; blk++) {   /* 只统计实际分配的块，空洞不计 */
+			if (dentry->inode->block_pointer[blk] >= 0) {
+				newfs_stat->st_blocks += NEWFS_BLKS_SZ() / 512;
+			}
+		}
 	}
 	else if (NEWFS_IS_SYM_LINK(dentry->inode)) {
 		newfs_stat->st_mode = S_IFLNK | NEWFS_DEFAULT_PERM;
@@ -674,8 +2050,25 @@ int newfs_readdir(const char * path, void * buf, fuse_fill_dir_t filler, off_t o
     struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
     struct newfs_dentry* sub_dentry;
     struct newfs_inode* inode;
+    const char* snap_name;
+    int   snap = newfs_snap_path(path, &snap_name);
+    if (snap == 1) {                                  /* 列出第offset个快照 */
+        for (int slot = 0; slot < NEWFS_SNAP_MAX; slot++) {
+            if (newfs_super.snaps[slot].ino != 0 && cur_dir-- == 0) {
+                filler(buf, newfs_super.snaps[slot].name, NULL, ++offset);
+                break;
+            }
+        }
+        return NEWFS_ERROR_NONE;
+    }
+    if (snap != 0) {                                  /* 快照内容需以--snapshot只读挂载后访问 */
+        return snap == 2 ? -NEWFS_ERROR_ACCESS : -NEWFS_ERROR_NOTFOUND;
+    }
     if (is_find) {
         inode = dentry->inode;
+        if (inode->is_corrupt) {
+            return -NEWFS_ERROR_IO;
+        }
         sub_dentry = newfs_get_dentry(inode, cur_dir);
         if (sub_dentry) {
             filler(buf, sub_dentry->fname, NULL, ++offset);
@@ -701,11 +2094,29 @@ int newfs_mknod(const char* path, mode_t mode, dev_t dev) {
     struct newfs_dentry* dentry;
     struct newfs_inode* inode;
     char* fname;
+    const char* snap_name;
+
+    switch (newfs_snap_path(path, &snap_name)) {
+    case 0:
+        break;
+    case 1:
+        return -NEWFS_ERROR_EXISTS;
+    default:                                          /* 快照目录下只能mkdir/rmdir */
+        return -NEWFS_ERROR_ACCESS;
+    }
 
-    if (is_find == true) {//文件存在
+    if (is_find == true || strcmp(path, NEWFS_STATS_PATH) == 0) {//文件存在
         return -NEWFS_ERROR_EXISTS;
     }
 
+    if (newfs_super.read_only) {
+        return -NEWFS_ERROR_ROFS;
+    }
+
+    if (last_dentry->inode->is_corrupt) {
+        return -NEWFS_ERROR_IO;
+    }
+
     fname = newfs_get_fname(path);//获取文件名字
 
     if (S_ISREG(mode)) {
@@ -716,173 +2127,896 @@ int newfs_mknod(const char* path, mode_t mode, dev_t dev) {
     }
     dentry->parent = last_dentry;
     inode = newfs_alloc_inode(dentry);
-    newfs_alloc_dentry(last_dentry->inode, dentry);
+    if (inode == NULL) {
+        free(dentry);
+        return -NEWFS_ERROR_NOSPACE;
+    }
+    if (newfs_alloc_dentry(last_dentry->inode, dentry) < 0) {
+        newfs_free_tree(dentry);
+        free(dentry);
+        return -NEWFS_ERROR_NOSPACE;
+    }
+
+    return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 修改时间，为了不让touch报错 
+ * 
+ * @param path 相对于挂载点的路径
+ * @param tv 实践
+ * @return int 0成功，否则失败
+ */
+int newfs_utimens(const char* path, const struct timespec tv[2]) {
+	(void)path;
+	return 0;
+}
+/******************************************************************************
+* SECTION: 选做函数实现
+*******************************************************************************/
+/**
+ * @brief 写入文件
+ * 
+ * @param path 相对于挂载点的路径
+ * @param buf 写入的内容
+ * @param size 写入的字节数
+ * @param offset 相对文件的偏移
+ * @param fi 可忽略
+ * @return int 写入大小
+ */
+int newfs_write(const char* path, const char* buf, size_t size, off_t offset,
+		        struct fuse_file_info* fi) {
+    bool is_find, is_root;
+	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
+	struct newfs_inode*  inode;
+	
+	if (newfs_super.read_only) {                      /* 快照以只读方式挂载 */
+		return -NEWFS_ERROR_ROFS;
+	}
+
+	if (is_find == false) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+
+	inode = dentry->inode;
+	
+	if (NEWFS_IS_DIR(inode)) {
+		return -NEWFS_ERROR_ISDIR;	
+	}
+
+	if (inode->is_corrupt) {
+		return -NEWFS_ERROR_IO;
+	}
+
+	if (offset + size > NEWFS_FILE_MAX_SZ()) {       /* 超过EOF的写入在中间留下空洞 */
+		return -NEWFS_ERROR_FBIG;
+	}
+
+	if (newfs_inflate(inode) != NEWFS_ERROR_NONE) {
+		return -NEWFS_ERROR_NOSPACE;
+	}
+
+	if (newfs_alloc_extent(inode, offset / NEWFS_BLKS_SZ(), 
+	                       NEWFS_ROUND_UP(offset + size, NEWFS_BLKS_SZ()) / NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+		return -NEWFS_ERROR_NOSPACE;
+	}
+
+	if (newfs_cow_blocks(inode, offset / NEWFS_BLKS_SZ(), 
+	                     NEWFS_ROUND_UP(offset + size, NEWFS_BLKS_SZ()) / NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+		return -NEWFS_ERROR_NOSPACE;
+	}
+
+	memcpy(inode->data + offset, buf, size);
+	newfs_mark_dirty(inode, offset / NEWFS_BLKS_SZ(), 
+	                 NEWFS_ROUND_UP(offset + size, NEWFS_BLKS_SZ()) / NEWFS_BLKS_SZ());
+	inode->size = offset + size > inode->size ? offset + size : inode->size;
+	
+	return size;
+}
+
+/**
+ * @brief 读取文件
+ * 
+ * @param path 相对于挂载点的路径
+ * @param buf 读取的内容
+ * @param size 读取的字节数
+ * @param offset 相对文件的偏移
+ * @param fi 可忽略
+ * @return int 读取大小
+ */
+int newfs_read(const char* path, char* buf, size_t size, off_t offset,
+		       struct fuse_file_info* fi) {
+	bool is_find, is_root;
+	struct newfs_dentry* dentry;
+	struct newfs_inode*  inode;
+	char*  stats_buf;
+	int    stats_len;
+
+	if (strcmp(path, NEWFS_STATS_PATH) == 0) {        /* 每次读取时重新汇总 */
+		stats_buf = newfs_stats_text(&stats_len);
+		if (offset >= stats_len) {
+			size = 0;
+		}
+		else {
+			size = offset + size > stats_len ? stats_len - offset : size;
+			memcpy(buf, stats_buf + offset, size);
+		}
+		free(stats_buf);
+		return size;
+	}
+
+	dentry = newfs_lookup(path, &is_find, &is_root);
+	if (is_find == false) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+
+	inode = dentry->inode;
+	
+	if (NEWFS_IS_DIR(inode)) {
+		return -NEWFS_ERROR_ISDIR;	
+	}
+
+	if (inode->is_corrupt) {
+		return -NEWFS_ERROR_IO;
+	}
+
+	if (inode->size <= offset) {
+		return 0;
+	}
+
+	if (offset + size > inode->size) {
+		size = inode->size - offset;
+	}
+
+	memcpy(buf, inode->data + offset, size);         /* 空洞在缓冲区中恒为0，无需设备IO */
+
+	return size;			   
+}
+
+/**
+ * @brief 删除文件
+ * 
+ * @param path 相对于挂载点的路径
+ * @return int 0成功，否则失败
+ */
+int newfs_unlink(const char* path) {
+	bool is_find, is_root;
+	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
+
+	if (newfs_super.read_only) {
+		return -NEWFS_ERROR_ROFS;
+	}
+
+	if (is_find == false) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+
+	if (NEWFS_IS_DIR(dentry->inode)) {
+		return -NEWFS_ERROR_ISDIR;
+	}
+
+	newfs_drop_dentry(dentry->parent->inode, dentry);
+	newfs_free_tree(dentry);
+	free(dentry);
+	return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 删除目录
+ * 
+ * 一个可能的删除目录操作如下：
+ * rm ./tests/mnt/j/ -r
+ *  1) Step 1. rm ./tests/mnt/j/j
+ *  2) Step 2. rm ./tests/mnt/j
+ * 即，先删除最深层的文件，再删除目录文件本身
+ * 
+ * @param path 相对于挂载点的路径
+ * @return int 0成功，否则失败
+ */
+int newfs_rmdir(const char* path) {
+	bool is_find, is_root;
+	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
+	const char* snap_name;
+
+	switch (newfs_snap_path(path, &snap_name)) {
+	case 0:
+		break;
+	case 2:                                           /* rmdir /.snapshots/NAME 即删除快照 */
+		return newfs_super.read_only ? -NEWFS_ERROR_ROFS : newfs_snap_delete(snap_name);
+	default:
+		return -NEWFS_ERROR_ACCESS;
+	}
+
+	if (newfs_super.read_only) {
+		return -NEWFS_ERROR_ROFS;
+	}
+
+	if (is_find == false) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+
+	if (is_root) {
+		return -NEWFS_ERROR_ACCESS;
+	}
+
+	if (!NEWFS_IS_DIR(dentry->inode)) {
+		return -NEWFS_ERROR_NOTDIR;
+	}
+
+	if (dentry->inode->dir_cnt != 0) {
+		return -NEWFS_ERROR_NOTEMPTY;
+	}
+
+	newfs_drop_dentry(dentry->parent->inode, dentry);
+	newfs_free_tree(dentry);
+	free(dentry);
+	return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 重命名文件 
+ * 
+ * @param from 源文件路径
+ * @param to 目标文件路径
+ * @return int 0成功，否则失败
+ */
+int newfs_rename(const char* from, const char* to) {
+	bool is_find, is_root;
+	struct newfs_dentry* from_dentry = newfs_lookup(from, &is_find, &is_root);
+	struct newfs_dentry* to_dentry;
+	struct newfs_dentry* to_parent;
+	struct newfs_dentry* old_parent;
+	struct newfs_dentry* cursor;
+	char   old_fname[NEWFS_MAX_FILE_NAME];
+	const char* snap_name;
+
+	if (newfs_super.read_only) {
+		return -NEWFS_ERROR_ROFS;
+	}
+
+	if (newfs_snap_path(from, &snap_name) != 0 || newfs_snap_path(to, &snap_name) != 0) {
+		return -NEWFS_ERROR_ACCESS;
+	}
+
+	if (is_find == false) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+
+	if (is_root) {
+		return -NEWFS_ERROR_ACCESS;
+	}
+
+	to_dentry = newfs_lookup(to, &is_find, &is_root);
+	if (is_find) {
+		if (to_dentry == from_dentry) {
+			return NEWFS_ERROR_NONE;
+		}
+		if (NEWFS_IS_DIR(to_dentry->inode) && !NEWFS_IS_DIR(from_dentry->inode)) {
+			return -NEWFS_ERROR_ISDIR;
+		}
+		if (!NEWFS_IS_DIR(to_dentry->inode) && NEWFS_IS_DIR(from_dentry->inode)) {
+			return -NEWFS_ERROR_NOTDIR;
+		}
+		if (NEWFS_IS_DIR(to_dentry->inode) && to_dentry->inode->dir_cnt != 0) {
+			return -NEWFS_ERROR_NOTEMPTY;
+		}
+		to_parent = to_dentry->parent;
+	}
+	else {
+		to_parent = to_dentry;
+		if (NEWFS_IS_REG(to_parent->inode)) {
+			return -NEWFS_ERROR_NOTDIR;
+		}
+	}
 
-    return NEWFS_ERROR_NONE;
+	for (cursor = to_parent; cursor != NULL; cursor = cursor->parent) {
+		if (cursor == from_dentry) {                  /* 不能移动到自身子树下 */
+			return -NEWFS_ERROR_INVAL;
+		}
+	}
+
+	if (is_find) {                                    /* 覆盖已存在的目标 */
+		newfs_drop_dentry(to_parent->inode, to_dentry);
+		newfs_free_tree(to_dentry);
+		free(to_dentry);
+	}
+
+	old_parent = from_dentry->parent;
+	memcpy(old_fname, from_dentry->fname, NEWFS_MAX_FILE_NAME);
+	newfs_drop_dentry(old_parent->inode, from_dentry);
+
+	memset(from_dentry->fname, 0, NEWFS_MAX_FILE_NAME);
+	NEWFS_ASSIGN_FNAME(from_dentry, newfs_get_fname(to));
+	from_dentry->parent = to_parent;
+	if (newfs_alloc_dentry(to_parent->inode, from_dentry) < 0) {
+		memcpy(from_dentry->fname, old_fname, NEWFS_MAX_FILE_NAME);
+		from_dentry->parent = old_parent;
+		newfs_alloc_dentry(old_parent->inode, from_dentry);
+		return -NEWFS_ERROR_NOSPACE;
+	}
+	return NEWFS_ERROR_NONE;
 }
 
 /**
- * @brief 修改时间，为了不让touch报错 
+ * @brief 打开文件，可以在这里维护fi的信息，例如，fi->fh可以理解为一个64位指针，可以把自己想保存的数据结构
+ * 保存在fh中
  * 
  * @param path 相对于挂载点的路径
- * @param tv 实践
+ * @param fi 文件信息
  * @return int 0成功，否则失败
  */
-int newfs_utimens(const char* path, const struct timespec tv[2]) {
-	(void)path;
+int newfs_open(const char* path, struct fuse_file_info* fi) {
+	if (strcmp(path, NEWFS_STATS_PATH) == 0) {        /* 内容随时变化，绕过页缓存 */
+		if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+			return -NEWFS_ERROR_ACCESS;
+		}
+		fi->direct_io = 1;
+	}
+	if (newfs_super.read_only && (fi->flags & O_ACCMODE) != O_RDONLY) {
+		return -NEWFS_ERROR_ROFS;
+	}
 	return 0;
 }
-/******************************************************************************
-* SECTION: 选做函数实现
-*******************************************************************************/
+
 /**
- * @brief 写入文件
+ * @brief 打开目录文件
  * 
  * @param path 相对于挂载点的路径
- * @param buf 写入的内容
- * @param size 写入的字节数
- * @param offset 相对文件的偏移
- * @param fi 可忽略
- * @return int 写入大小
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
  */
-int newfs_write(const char* path, const char* buf, size_t size, off_t offset,
-		        struct fuse_file_info* fi) {
-    bool is_find, is_root;
+int newfs_opendir(const char* path, struct fuse_file_info* fi) {
+	/* 选做 */
+	return 0;
+}
+
+/**
+ * @brief 改变文件大小
+ * 
+ * @param path 相对于挂载点的路径
+ * @param offset 改变后文件大小
+ * @return int 0成功，否则失败
+ */
+int newfs_truncate(const char* path, off_t offset) {
+	bool is_find, is_root;
 	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
 	struct newfs_inode*  inode;
-	
+
+	if (newfs_super.read_only) {
+		return -NEWFS_ERROR_ROFS;
+	}
+
 	if (is_find == false) {
 		return -NEWFS_ERROR_NOTFOUND;
 	}
 
 	inode = dentry->inode;
-	
+
 	if (NEWFS_IS_DIR(inode)) {
-		return -NEWFS_ERROR_ISDIR;	
+		return -NEWFS_ERROR_ISDIR;
 	}
 
-	if (inode->size < offset) {
-		return -NEWFS_ERROR_SEEK;
+	if (inode->is_corrupt) {                          /* 记录不会刷回，不能改动它引用的数据块 */
+		return -NEWFS_ERROR_IO;
 	}
 
-	memcpy(inode->data + offset, buf, size);
-	inode->size = offset + size > inode->size ? offset + size : inode->size;
-	
-	return size;
+	if (offset > NEWFS_FILE_MAX_SZ()) {
+		return -NEWFS_ERROR_FBIG;
+	}
+
+	if (newfs_inflate(inode) != NEWFS_ERROR_NONE) {
+		return -NEWFS_ERROR_NOSPACE;
+	}
+
+	if (offset < inode->size) {                       /* 缩小：归还尾部数据块 */
+		if (newfs_cow_blocks(inode, offset / NEWFS_BLKS_SZ(), 
+		                     NEWFS_ROUND_UP(offset, NEWFS_BLKS_SZ()) / NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+			return -NEWFS_ERROR_NOSPACE;
+		}
+		newfs_free_blocks(inode->block_pointer, NEWFS_ROUND_UP(offset, NEWFS_BLKS_SZ()) / NEWFS_BLKS_SZ(),
+		                  NEWFS_DATA_PER_FILE);
+		memset(inode->data + offset, 0, inode->size - offset);
+		newfs_mark_dirty(inode, offset / NEWFS_BLKS_SZ(), offset / NEWFS_BLKS_SZ() + 1);
+	}
+	inode->size = offset;                             /* 扩大：新增部分为空洞，不分配数据块 */
+	return NEWFS_ERROR_NONE;
 }
 
+
 /**
- * @brief 读取文件
+ * @brief 预分配文件空间，预留的数据块尽量物理连续
  * 
  * @param path 相对于挂载点的路径
- * @param buf 读取的内容
- * @param size 读取的字节数
- * @param offset 相对文件的偏移
+ * @param mode 0或FALLOC_FL_KEEP_SIZE（不改变文件大小）
+ * @param offset 预分配起始位置
+ * @param length 预分配长度
  * @param fi 可忽略
- * @return int 读取大小
+ * @return int 0成功，否则失败
  */
-int newfs_read(const char* path, char* buf, size_t size, off_t offset,
-		       struct fuse_file_info* fi) {
+int newfs_fallocate(const char* path, int mode, off_t offset, off_t length,
+                    struct fuse_file_info* fi) {
 	bool is_find, is_root;
 	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
 	struct newfs_inode*  inode;
 
+	if (newfs_super.read_only) {
+		return -NEWFS_ERROR_ROFS;
+	}
+
 	if (is_find == false) {
 		return -NEWFS_ERROR_NOTFOUND;
 	}
 
 	inode = dentry->inode;
-	
+
 	if (NEWFS_IS_DIR(inode)) {
-		return -NEWFS_ERROR_ISDIR;	
+		return -NEWFS_ERROR_ISDIR;
 	}
 
-	if (inode->size < offset) {
-		return -NEWFS_ERROR_SEEK;
+	if (inode->is_corrupt) {
+		return -NEWFS_ERROR_IO;
 	}
 
-	memcpy(buf, inode->data + offset, size);
+	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE)) {
+		return -NEWFS_ERROR_OPNOTSUPP;
+	}
 
-	return size;			   
+	if (offset < 0 || length <= 0) {
+		return -NEWFS_ERROR_INVAL;
+	}
+
+	if (newfs_inflate(inode) != NEWFS_ERROR_NONE) {
+		return -NEWFS_ERROR_NOSPACE;
+	}
+
+	if (mode & FALLOC_FL_PUNCH_HOLE) {                /* 打洞：清零并归还完整覆盖的块 */
+		if (!(mode & FALLOC_FL_KEEP_SIZE)) {
+			return -NEWFS_ERROR_OPNOTSUPP;
+		}
+		if (offset >= NEWFS_FILE_MAX_SZ()) {
+			return NEWFS_ERROR_NONE;
+		}
+		if (offset + length > NEWFS_FILE_MAX_SZ()) {
+			length = NEWFS_FILE_MAX_SZ() - offset;
+		}
+		if (newfs_cow_blocks(inode, offset / NEWFS_BLKS_SZ(), 
+		                     NEWFS_ROUND_UP(offset + length, NEWFS_BLKS_SZ()) / NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+			return -NEWFS_ERROR_NOSPACE;
+		}
+		memset(inode->data + offset, 0, length);
+		newfs_mark_dirty(inode, offset / NEWFS_BLKS_SZ(), 
+		                 NEWFS_ROUND_UP(offset + length, NEWFS_BLKS_SZ()) / NEWFS_BLKS_SZ());
+		newfs_free_blocks(inode->block_pointer, NEWFS_ROUND_UP(offset, NEWFS_BLKS_SZ()) / NEWFS_BLKS_SZ(),
+		                  (offset + length) / NEWFS_BLKS_SZ());
+		return NEWFS_ERROR_NONE;
+	}
+
+	if (offset + length > NEWFS_FILE_MAX_SZ()) {
+		return -NEWFS_ERROR_FBIG;
+	}
+
+	if (newfs_alloc_extent(inode, offset / NEWFS_BLKS_SZ(), 
+	                       NEWFS_ROUND_UP(offset + length, NEWFS_BLKS_SZ()) / NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+		return -NEWFS_ERROR_NOSPACE;
+	}
+
+	if (!(mode & FALLOC_FL_KEEP_SIZE) && offset + length > inode->size) {
+		inode->size = offset + length;
+	}
+	return NEWFS_ERROR_NONE;
 }
 
 /**
- * @brief 删除文件
+ * @brief 文件间拷贝数据。源与目标在块内偏移一致时，整块以共享数据块+引用计数的方式克隆，
+ * 不产生数据IO，之后任一方写入时写时复制；其余部分在文件系统内部逐字节拷贝
  * 
- * @param path 相对于挂载点的路径
- * @return int 0成功，否则失败
+ * @param path_in 源文件路径
+ * @param fi_in 可忽略
+ * @param offset_in 源文件偏移
+ * @param path_out 目标文件路径
+ * @param fi_out 可忽略
+ * @param offset_out 目标文件偏移
+ * @param size 拷贝的字节数
+ * @param flags 必须为0
+ * @return ssize_t 拷贝的字节数
  */
-int newfs_unlink(const char* path) {
-	/* 选做 */
-	return 0;
+ssize_t newfs_copy_file_range(const char* path_in, struct fuse_file_info* fi_in, off_t offset_in,
+                              const char* path_out, struct fuse_file_info* fi_out, off_t offset_out,
+                              size_t size, int flags) {
+	bool is_find, is_root;
+	struct newfs_dentry* dentry_in = newfs_lookup(path_in, &is_find, &is_root);
+	struct newfs_dentry* dentry_out;
+	struct newfs_inode*  inode_in;
+	struct newfs_inode*  inode_out;
+	off_t  cursor, chunk, blk_in, blk_out;
+
+	if (newfs_super.read_only) {
+		return -NEWFS_ERROR_ROFS;
+	}
+
+	if (is_find == false) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+	dentry_out = newfs_lookup(path_out, &is_find, &is_root);
+	if (is_find == false) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+	inode_in  = dentry_in->inode;
+	inode_out = dentry_out->inode;
+
+	if (NEWFS_IS_DIR(inode_in) || NEWFS_IS_DIR(inode_out)) {
+		return -NEWFS_ERROR_ISDIR;
+	}
+	if (inode_in->is_corrupt || inode_out->is_corrupt) {
+		return -NEWFS_ERROR_IO;
+	}
+	if (flags != 0 || offset_in < 0 || offset_out < 0) {
+		return -NEWFS_ERROR_INVAL;
+	}
+	if (offset_in >= inode_in->size) {
+		return 0;
+	}
+	if (offset_in + size > inode_in->size) {
+		size = inode_in->size - offset_in;
+	}
+	if (offset_out + size > NEWFS_FILE_MAX_SZ()) {
+		return -NEWFS_ERROR_FBIG;
+	}
+	if (inode_in == inode_out && offset_in < offset_out + size && offset_out < offset_in + size) {
+		return -NEWFS_ERROR_INVAL;                    /* 同一文件内区间重叠 */
+	}
+	if (newfs_inflate(inode_in) != NEWFS_ERROR_NONE || newfs_inflate(inode_out) != NEWFS_ERROR_NONE) {
+		return -NEWFS_ERROR_NOSPACE;                  /* 克隆按逻辑块共享，需未压缩布局 */
+	}
+
+	for (cursor = 0; cursor < size; cursor += chunk) {
+		blk_in  = (offset_in + cursor) / NEWFS_BLKS_SZ();
+		blk_out = (offset_out + cursor) / NEWFS_BLKS_SZ();
+		chunk   = NEWFS_BLKS_SZ() - (offset_out + cursor) % NEWFS_BLKS_SZ();
+		if (chunk > size - cursor) {
+			chunk = size - cursor;
+		}
+		if ((offset_in + cursor) % NEWFS_BLKS_SZ() == 0 && (offset_out + cursor) % NEWFS_BLKS_SZ() == 0 &&
+		    (chunk == NEWFS_BLKS_SZ() ||              /* 不足一块时，两侧都须到达EOF */
+		     (offset_out + cursor + chunk >= inode_out->size && offset_in + cursor + chunk >= inode_in->size)) &&
+		    (inode_in->block_pointer[blk_in] < 0 || 
+		     newfs_super.map_ref[inode_in->block_pointer[blk_in]] < NEWFS_REF_MAX)) {
+			                                          /* 整块克隆：共享源数据块，源块未刷盘时先写回 */
+			if (inode_in->block_pointer[blk_in] >= 0 && (inode_in->dirty & (0x1 << blk_in))) {
+				if (newfs_cow_blocks(inode_in, blk_in, blk_in + 1) != NEWFS_ERROR_NONE ||
+				    newfs_driver_write(NEWFS_DA_OFS(inode_in->block_pointer[blk_in]), 
+				                       inode_in->data + blk_in * NEWFS_BLKS_SZ(), NEWFS_BLKS_SZ()) != NEWFS_ERROR_NONE) {
+					break;
+				}
+				inode_in->dirty &= ~(0x1 << blk_in);
+			}
+			newfs_free_blocks(inode_out->block_pointer, blk_out, blk_out + 1);
+			inode_out->block_pointer[blk_out] = inode_in->block_pointer[blk_in];
+			if (inode_out->block_pointer[blk_out] >= 0) {
+				newfs_super.map_ref[inode_out->block_pointer[blk_out]]++;
+			}
+			memcpy(inode_out->data + blk_out * NEWFS_BLKS_SZ(), 
+			       inode_in->data + blk_in * NEWFS_BLKS_SZ(), NEWFS_BLKS_SZ());
+			inode_out->dirty &= ~(0x1 << blk_out);
+			continue;
+		}
+		                                              /* 回退：文件系统内部拷贝 */
+		if (newfs_alloc_extent(inode_out, blk_out, blk_out + 1) != NEWFS_ERROR_NONE ||
+		    newfs_cow_blocks(inode_out, blk_out, blk_out + 1) != NEWFS_ERROR_NONE) {
+			break;
+		}
+		memcpy(inode_out->data + offset_out + cursor, inode_in->data + offset_in + cursor, chunk);
+		newfs_mark_dirty(inode_out, blk_out, blk_out + 1);
+	}
+
+	if (cursor == 0 && size != 0) {
+		return -NEWFS_ERROR_NOSPACE;
+	}
+	if (offset_out + cursor > inode_out->size) {
+		inode_out->size = offset_out + cursor;
+	}
+	return cursor;
 }
 
 /**
- * @brief 删除目录
- * 
- * 一个可能的删除目录操作如下：
- * rm ./tests/mnt/j/ -r
- *  1) Step 1. rm ./tests/mnt/j/j
- *  2) Step 2. rm ./tests/mnt/j
- * 即，先删除最深层的文件，再删除目录文件本身
+ * @brief 把path_out整体替换为path_in的克隆，数据块共享，之后写时复制。
+ * FUSE 2.6没有copy_file_range，由设置NEWFS_CLONE_XATTR调用
  * 
- * @param path 相对于挂载点的路径
+ * @param path_in 源文件路径
+ * @param path_out 目标文件路径，须已存在
  * @return int 0成功，否则失败
  */
-int newfs_rmdir(const char* path) {
-	/* 选做 */
-	return 0;
+int newfs_clone_file(const char* path_in, const char* path_out) {
+	bool is_find, is_root;
+	struct newfs_dentry* dentry_in = newfs_lookup(path_in, &is_find, &is_root);
+	struct newfs_dentry* dentry_out;
+	ssize_t copied;
+	int     ret;
+
+	if (is_find == false) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+	dentry_out = newfs_lookup(path_out, &is_find, &is_root);
+	if (is_find == false) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+	if (NEWFS_IS_DIR(dentry_in->inode) || NEWFS_IS_DIR(dentry_out->inode)) {
+		return -NEWFS_ERROR_ISDIR;
+	}
+	if (dentry_in->inode == dentry_out->inode) {
+		return -NEWFS_ERROR_INVAL;
+	}
+	if (dentry_in->inode->is_corrupt) {               /* 先检查源文件，失败时目标文件保持不变 */
+		return -NEWFS_ERROR_IO;
+	}
+	ret = newfs_truncate(path_out, 0);
+	if (ret != NEWFS_ERROR_NONE) {
+		return ret;
+	}
+	copied = newfs_copy_file_range(path_in, NULL, 0, path_out, NULL, 0, dentry_in->inode->size, 0);
+	if (copied < 0) {
+		return copied;
+	}
+	return copied == dentry_in->inode->size ? NEWFS_ERROR_NONE : -NEWFS_ERROR_NOSPACE;
 }
 
 /**
- * @brief 重命名文件 
+ * @brief 设置扩展属性。条目放得下时存入inode记录的内联区，否则存入xattr块。
+ * 对根目录设置NEWFS_GROW_XATTR不保存属性，而是在线扩容到属性值给出的字节数；
+ * 对文件设置NEWFS_CLONE_XATTR也不保存属性，而是把文件替换为属性值所指文件的克隆
  * 
- * @param from 源文件路径
- * @param to 目标文件路径
+ * @param path 相对于挂载点的路径
+ * @param name 属性名
+ * @param value 属性值
+ * @param size 属性值长度
+ * @param flags XATTR_CREATE: 已存在则失败；XATTR_REPLACE: 不存在则失败
  * @return int 0成功，否则失败
  */
-int newfs_rename(const char* from, const char* to) {
-	/* 选做 */
-	return 0;
+int newfs_setxattr(const char* path, const char* name, const char* value, size_t size, int flags) {
+	bool is_find, is_root;
+	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
+	struct newfs_inode*  inode;
+	struct newfs_xattr_d* xattr_d;
+	uint8_t inline_bak[NEWFS_XATTR_INLINE_SZ];
+	int     entry_sz, ofs_inline, ofs_blk = -1, blk_free;
+	char    grow_buf[32];
+
+	if (newfs_super.read_only) {
+		return -NEWFS_ERROR_ROFS;
+	}
+
+	if (strcmp(path, "/") == 0 && strcmp(name, NEWFS_GROW_XATTR) == 0) {
+		if (size == 0 || size >= sizeof(grow_buf)) {
+			return -NEWFS_ERROR_INVAL;
+		}
+		memcpy(grow_buf, value, size);
+		grow_buf[size] = '\0';
+		return newfs_grow(strtol(grow_buf, NULL, 0));
+	}
+
+	if (strcmp(name, NEWFS_CLONE_XATTR) == 0) {
+		char* path_in = strndup(value, size);
+		int   ret     = newfs_clone_file(path_in, path);
+		free(path_in);
+		return ret;
+	}
+
+	if (is_find == false) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+	inode = dentry->inode;
+	if (inode->is_corrupt) {
+		return -NEWFS_ERROR_IO;
+	}
+	if (strlen(name) == 0) {
+		return -NEWFS_ERROR_INVAL;
+	}
+	if (strlen(name) > NEWFS_XATTR_NAME_MAX) {
+		return -NEWFS_ERROR_RANGE;
+	}
+	entry_sz = sizeof(struct newfs_xattr_d) + strlen(name) + size;
+	if (entry_sz > NEWFS_BLKS_SZ()) {
+		return -NEWFS_ERROR_2BIG;
+	}
+	if (newfs_xattr_load(inode) != NEWFS_ERROR_NONE) {
+		return -NEWFS_ERROR_IO;
+	}
+
+	ofs_inline = newfs_xattr_find(inode->xattr_inline, NEWFS_XATTR_INLINE_SZ, name);
+	if (inode->xattr_buf != NULL) {
+		ofs_blk = newfs_xattr_find(inode->xattr_buf, NEWFS_BLKS_SZ(), name);
+	}
+	if ((flags & XATTR_CREATE) && (ofs_inline >= 0 || ofs_blk >= 0)) {
+		return -NEWFS_ERROR_EXISTS;
+	}
+	if ((flags & XATTR_REPLACE) && ofs_inline < 0 && ofs_blk < 0) {
+		return -NEWFS_ERROR_NODATA;
+	}
+	                                                  /* 放不下时原值保持不变 */
+	memcpy(inline_bak, inode->xattr_inline, NEWFS_XATTR_INLINE_SZ);
+	if (ofs_inline >= 0) {
+		newfs_xattr_del(inode->xattr_inline, NEWFS_XATTR_INLINE_SZ, ofs_inline);
+	}
+	if (newfs_xattr_used(inode->xattr_inline, NEWFS_XATTR_INLINE_SZ) + entry_sz <= NEWFS_XATTR_INLINE_SZ) {
+		newfs_xattr_add(inode->xattr_inline, NEWFS_XATTR_INLINE_SZ, name, value, size);
+		if (ofs_blk >= 0) {
+			newfs_xattr_del(inode->xattr_buf, NEWFS_BLKS_SZ(), ofs_blk);
+			inode->xattr_dirty = true;
+		}
+		return NEWFS_ERROR_NONE;
+	}
+	blk_free = NEWFS_BLKS_SZ();
+	if (inode->xattr_buf != NULL) {
+		blk_free -= newfs_xattr_used(inode->xattr_buf, NEWFS_BLKS_SZ());
+		if (ofs_blk >= 0) {
+			xattr_d   = (struct newfs_xattr_d *)(inode->xattr_buf + ofs_blk);
+			blk_free += sizeof(struct newfs_xattr_d) + xattr_d->name_len + xattr_d->value_len;
+		}
+	}
+	if (entry_sz > blk_free) {
+		memcpy(inode->xattr_inline, inline_bak, NEWFS_XATTR_INLINE_SZ);
+		return -NEWFS_ERROR_NOSPACE;
+	}
+	if (inode->xattr_buf == NULL) {                   /* 首个放不进内联区的xattr，分配xattr块 */
+		inode->xattr_blk = newfs_data_alloc(-1, 1);
+		if (inode->xattr_blk < 0) {
+			memcpy(inode->xattr_inline, inline_bak, NEWFS_XATTR_INLINE_SZ);
+			return -NEWFS_ERROR_NOSPACE;
+		}
+		newfs_super.sz_usage += NEWFS_BLKS_SZ();
+		inode->xattr_buf = (uint8_t *)calloc(1, NEWFS_BLKS_SZ());
+	}
+	if (ofs_blk >= 0) {
+		newfs_xattr_del(inode->xattr_buf, NEWFS_BLKS_SZ(), ofs_blk);
+	}
+	newfs_xattr_add(inode->xattr_buf, NEWFS_BLKS_SZ(), name, value, size);
+	inode->xattr_dirty = true;
+	return NEWFS_ERROR_NONE;
 }
 
 /**
- * @brief 打开文件，可以在这里维护fi的信息，例如，fi->fh可以理解为一个64位指针，可以把自己想保存的数据结构
- * 保存在fh中
+ * @brief 读取扩展属性，内联区未命中时最多读一次xattr块
  * 
  * @param path 相对于挂载点的路径
- * @param fi 文件信息
- * @return int 0成功，否则失败
+ * @param name 属性名
+ * @param value 输出缓冲区
+ * @param size 缓冲区大小，为0时只返回属性值长度
+ * @return int 属性值长度，否则失败
  */
-int newfs_open(const char* path, struct fuse_file_info* fi) {
-	/* 选做 */
-	return 0;
+int newfs_getxattr(const char* path, const char* name, char* value, size_t size) {
+	bool is_find, is_root;
+	struct newfs_dentry*  dentry = newfs_lookup(path, &is_find, &is_root);
+	struct newfs_inode*   inode;
+	struct newfs_xattr_d* xattr_d;
+	uint8_t* area = NULL;
+	int      ofs;
+
+	if (is_find == false) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+	inode = dentry->inode;
+	if (inode->is_corrupt) {
+		return -NEWFS_ERROR_IO;
+	}
+
+	ofs = newfs_xattr_find(inode->xattr_inline, NEWFS_XATTR_INLINE_SZ, name);
+	if (ofs >= 0) {
+		NEWFS_STAT(xattr_hit, 1);
+		area = inode->xattr_inline;
+	}
+	else if (inode->xattr_blk >= 0) {
+		NEWFS_STAT(xattr_miss, 1);
+		if (newfs_xattr_load(inode) != NEWFS_ERROR_NONE) {
+			return -NEWFS_ERROR_IO;
+		}
+		ofs  = newfs_xattr_find(inode->xattr_buf, NEWFS_BLKS_SZ(), name);
+		area = inode->xattr_buf;
+	}
+	if (ofs < 0) {
+		return -NEWFS_ERROR_NODATA;
+	}
+
+	xattr_d = (struct newfs_xattr_d *)(area + ofs);
+	if (size == 0) {
+		return xattr_d->value_len;
+	}
+	if (size < xattr_d->value_len) {
+		return -NEWFS_ERROR_RANGE;
+	}
+	memcpy(value, area + ofs + sizeof(struct newfs_xattr_d) + xattr_d->name_len, xattr_d->value_len);
+	return xattr_d->value_len;
 }
 
 /**
- * @brief 打开目录文件
+ * @brief 列出所有扩展属性名，以'\0'分隔
  * 
  * @param path 相对于挂载点的路径
- * @param fi 文件信息
- * @return int 0成功，否则失败
+ * @param list 输出缓冲区
+ * @param size 缓冲区大小，为0时只返回所需长度
+ * @return int 名字列表总长度，否则失败
  */
-int newfs_opendir(const char* path, struct fuse_file_info* fi) {
-	/* 选做 */
-	return 0;
+int newfs_listxattr(const char* path, char* list, size_t size) {
+	bool is_find, is_root;
+	struct newfs_dentry*  dentry = newfs_lookup(path, &is_find, &is_root);
+	struct newfs_inode*   inode;
+	struct newfs_xattr_d* xattr_d;
+	uint8_t* areas[2];
+	int      area_szs[2] = { NEWFS_XATTR_INLINE_SZ, NEWFS_BLKS_SZ() };
+	int      total = 0, ofs, used;
+
+	if (is_find == false) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+	inode = dentry->inode;
+	if (inode->is_corrupt || newfs_xattr_load(inode) != NEWFS_ERROR_NONE) {
+		return -NEWFS_ERROR_IO;
+	}
+	areas[0] = inode->xattr_inline;
+	areas[1] = inode->xattr_buf;
+
+	for (int i = 0; i < 2 && areas[i] != NULL; i++) {
+		used = newfs_xattr_used(areas[i], area_szs[i]);
+		for (ofs = 0; ofs < used; ofs += sizeof(struct newfs_xattr_d) + xattr_d->name_len + xattr_d->value_len) {
+			xattr_d = (struct newfs_xattr_d *)(areas[i] + ofs);
+			if (size != 0) {
+				if (total + xattr_d->name_len + 1 > size) {
+					return -NEWFS_ERROR_RANGE;
+				}
+				memcpy(list + total, areas[i] + ofs + sizeof(struct newfs_xattr_d), xattr_d->name_len);
+				list[total + xattr_d->name_len] = '\0';
+			}
+			total += xattr_d->name_len + 1;
+		}
+	}
+	return total;
 }
 
 /**
- * @brief 改变文件大小
+ * @brief 删除扩展属性，xattr块清空时归还该块
  * 
  * @param path 相对于挂载点的路径
- * @param offset 改变后文件大小
+ * @param name 属性名
  * @return int 0成功，否则失败
  */
-int newfs_truncate(const char* path, off_t offset) {
-	/* 选做 */
-	return 0;
-}
+int newfs_removexattr(const char* path, const char* name) {
+	bool is_find, is_root;
+	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
+	struct newfs_inode*  inode;
+	int    ofs;
+
+	if (newfs_super.read_only) {
+		return -NEWFS_ERROR_ROFS;
+	}
+
+	if (is_find == false) {
+		return -NEWFS_ERROR_NOTFOUND;
+	}
+	inode = dentry->inode;
+	if (inode->is_corrupt) {
+		return -NEWFS_ERROR_IO;
+	}
 
+	ofs = newfs_xattr_find(inode->xattr_inline, NEWFS_XATTR_INLINE_SZ, name);
+	if (ofs >= 0) {
+		newfs_xattr_del(inode->xattr_inline, NEWFS_XATTR_INLINE_SZ, ofs);
+		return NEWFS_ERROR_NONE;
+	}
+	if (newfs_xattr_load(inode) != NEWFS_ERROR_NONE) {
+		return -NEWFS_ERROR_IO;
+	}
+	if (inode->xattr_buf == NULL || (ofs = newfs_xattr_find(inode->xattr_buf, NEWFS_BLKS_SZ(), name)) < 0) {
+		return -NEWFS_ERROR_NODATA;
+	}
+	newfs_xattr_del(inode->xattr_buf, NEWFS_BLKS_SZ(), ofs);
+	inode->xattr_dirty = true;
+	if (newfs_xattr_used(inode->xattr_buf, NEWFS_BLKS_SZ()) == 0) {
+		newfs_free_blocks(&inode->xattr_blk, 0, 1);
+		free(inode->xattr_buf);
+		inode->xattr_buf   = NULL;
+		inode->xattr_dirty = false;
+	}
+	return NEWFS_ERROR_NONE;
+}
 
 /**
  * @brief 访问文件，因为读写文件时需要查看权限
@@ -901,19 +3035,70 @@ int newfs_access(const char* path, int type) {
 	return 0;
 }	
 /******************************************************************************
-* SECTION: FUSE入口
+* SECTION: FUSE入口，进程内基准（bench/）自带main，以NEWFS_BENCH排除
 *******************************************************************************/
+#ifndef NEWFS_BENCH
+/**
+ * @brief 挂载前检查设备：拒绝旧布局的镜像，--snapshot给出的快照须存在。
+ * newfs_init的返回值会被FUSE当作私有数据，无法在那里让挂载失败
+ * 
+ * @return int 0可以挂载，否则失败
+ */
+static int newfs_mount_check(void) {
+	struct newfs_super_d newfs_super_d;
+	int      driver_fd = ddriver_open(newfs_options.device);
+	int      sz_io, size_aligned, slot;
+	uint8_t* buf;
+
+	if (driver_fd < 0) {
+		fprintf(stderr, "cannot open device %s\n", newfs_options.device);
+		return -NEWFS_ERROR_IO;
+	}
+	ddriver_ioctl(driver_fd, IOC_REQ_DEVICE_IO_SZ, &sz_io);
+	size_aligned = NEWFS_ROUND_UP(sizeof(struct newfs_super_d), sz_io);
+	buf = (uint8_t *)malloc(size_aligned);
+	ddriver_seek(driver_fd, NEWFS_SUPER_OFS, SEEK_SET);
+	for (int ofs = 0; ofs < size_aligned; ofs += sz_io) {
+		ddriver_read(driver_fd, (char *)buf + ofs, sz_io);
+	}
+	memcpy(&newfs_super_d, buf, sizeof(struct newfs_super_d));
+	free(buf);
+	ddriver_close(driver_fd);
+
+	if (newfs_super_d.magic_num == NEWFS_MAGIC_NUM_V1) {
+		fprintf(stderr, "%s has the old newfs layout, reformat it to mount\n", newfs_options.device);
+		return -NEWFS_ERROR_INVAL;
+	}
+	if (newfs_options.snapshot == NULL) {
+		return NEWFS_ERROR_NONE;
+	}
+	for (slot = 0; newfs_super_d.magic_num == NEWFS_MAGIC_NUM && slot < NEWFS_SNAP_MAX; slot++) {
+		if (newfs_super_d.snaps[slot].ino != 0 && 
+		    strncmp(newfs_super_d.snaps[slot].name, newfs_options.snapshot, NEWFS_SNAP_NAME) == 0) {
+			return NEWFS_ERROR_NONE;
+		}
+	}
+	fprintf(stderr, "snapshot %s not found on %s\n", newfs_options.snapshot, newfs_options.device);
+	return -NEWFS_ERROR_NOTFOUND;
+}
+
 int main(int argc, char **argv)
 {
     int ret;
 	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
 
 	newfs_options.device = strdup("TODO: 这里填写你的ddriver设备路径");
+	newfs_options.scrub_rate = NEWFS_SCRUB_RATE;
+	newfs_options.log_level = NEWFS_LOG_WARN;
 
 	if (fuse_opt_parse(&args, &newfs_options, option_spec, NULL) == -1)
 		return -1;
+
+	if (newfs_mount_check() != NEWFS_ERROR_NONE)
+		return -1;
 	
 	ret = fuse_main(args.argc, args.argv, &operations, NULL);
 	fuse_opt_free_args(&args);
 	return ret;
-}
\ No newline at end of file
+}
+#endif /* NEWFS_BENCH */
\ No newline at end of file
@@ -0,0 +1,185 @@
+#include "newfs.h"
+
+/******************************************************************************
+* SECTION: 运行时统计
+*
+* 每个线程首次计数时分配一份私有计数器并挂入全局链表，热路径上只写本线程的
+* 计数器（无锁、无原子读改写）；读取/.newfs_stats时遍历链表汇总。
+*******************************************************************************/
+static const char*          newfs_stats_op_names[NEWFS_OP_NUM] = {
+    "getattr", "lookup", "read", "write", "readdir", "mknod", "sync"
+};
+static struct newfs_stats*  newfs_stats_list = NULL;   /* 所有线程的计数器 */
+static pthread_mutex_t      newfs_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct newfs_stats* newfs_stats_tls = NULL;
+
+/**
+ * @brief 取得当前线程的计数器，首次调用时分配并登记
+ *
+ * @return struct newfs_stats*
+ */
+struct newfs_stats* newfs_stats_local(void) {
+    if (newfs_stats_tls == NULL) {
+        newfs_stats_tls = (struct newfs_stats *)calloc(1, sizeof(struct newfs_stats));
+        pthread_mutex_lock(&newfs_stats_lock);
+        newfs_stats_tls->next = newfs_stats_list;
+        newfs_stats_list      = newfs_stats_tls;
+        pthread_mutex_unlock(&newfs_stats_lock);
+    }
+    return newfs_stats_tls;
+}
+
+/**
+ * @brief 单调时钟，纳秒
+ *
+ * @return uint64_t
+ */
+uint64_t newfs_stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief 记录一次操作：计数、累计耗时，并按log2(纳秒)放入直方图
+ *
+ * @param op NEWFS_OP_*
+ * @param start newfs_stats_now()取得的开始时间
+ */
+void newfs_stats_op(int op, uint64_t start) {
+    struct newfs_stats* stats = newfs_stats_local();
+    uint64_t ns     = newfs_stats_now() - start;
+    int      bucket = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+    if (bucket >= NEWFS_STATS_BUCKETS) {
+        bucket = NEWFS_STATS_BUCKETS - 1;
+    }
+    NEWFS_STAT_ADD(stats->op_cnt[op], 1);
+    NEWFS_STAT_ADD(stats->op_ns[op], ns);
+    NEWFS_STAT_ADD(stats->op_hist[op][bucket], 1);
+}
+
+/**
+ * @brief 由直方图估计分位数，返回所在桶的上界
+ *
+ * @param hist
+ * @param cnt 样本数
+ * @param pct 百分位
+ * @return uint64_t 纳秒
+ */
+static uint64_t newfs_stats_percentile(uint64_t* hist, uint64_t cnt, int pct) {
+    uint64_t seen = 0, want = (cnt * pct + 99) / 100;
+    for (int bucket = 0; bucket < NEWFS_STATS_BUCKETS; bucket++) {
+        seen += hist[bucket];
+        if (seen >= want) {
+            return bucket == 0 ? 0 : 1ULL << bucket;
+        }
+    }
+    return 1ULL << (NEWFS_STATS_BUCKETS - 1);
+}
+
+/**
+ * @brief 汇总所有线程的计数器并输出为文本
+ *
+ * @param buf 输出缓冲区
+ * @param size 缓冲区大小
+ * @return int 输出长度
+ */
+int newfs_stats_render(char* buf, int size) {
+    struct newfs_stats  sum;
+    struct newfs_stats* stats;
+    uint64_t* fields     = (uint64_t *)&sum;
+    int       nfields    = offsetof(struct newfs_stats, next) / sizeof(uint64_t);
+    int       len        = 0;
+
+    memset(&sum, 0, sizeof(sum));
+    pthread_mutex_lock(&newfs_stats_lock);
+    for (stats = newfs_stats_list; stats != NULL; stats = stats->next) {
+        for (int i = 0; i < nfields; i++) {
+            fields[i] += __atomic_load_n(&((uint64_t *)stats)[i], __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&newfs_stats_lock);
+
+#define NEWFS_STATS_PRINT(...) \
+    len += snprintf(buf + len, len < size ? size - len : 0, __VA_ARGS__)
+    NEWFS_STATS_PRINT("%-8s %10s %10s %10s %10s\n", "op", "count", "avg_ns", "p50_ns", "p99_ns");
+    for (int op = 0; op < NEWFS_OP_NUM; op++) {
+        NEWFS_STATS_PRINT("%-8s %10lu %10lu %10lu %10lu\n", newfs_stats_op_names[op],
+                          sum.op_cnt[op], sum.op_cnt[op] ? sum.op_ns[op] / sum.op_cnt[op] : 0,
+                          newfs_stats_percentile(sum.op_hist[op], sum.op_cnt[op], 50),
+                          newfs_stats_percentile(sum.op_hist[op], sum.op_cnt[op], 99));
+    }
+    NEWFS_STATS_PRINT("\nlatency histogram (bucket <= ns: count)\n");
+    for (int op = 0; op < NEWFS_OP_NUM; op++) {
+        if (sum.op_cnt[op] == 0) {
+            continue;
+        }
+        NEWFS_STATS_PRINT("%-8s", newfs_stats_op_names[op]);
+        for (int bucket = 0; bucket < NEWFS_STATS_BUCKETS; bucket++) {
+            if (sum.op_hist[op][bucket] != 0) {
+                NEWFS_STATS_PRINT(" %lu:%lu", bucket == 0 ? 0 : 1UL << bucket, sum.op_hist[op][bucket]);
+            }
+        }
+        NEWFS_STATS_PRINT("\n");
+    }
+    NEWFS_STATS_PRINT("\ndev_read_ios %lu\ndev_read_bytes %lu\ndev_write_ios %lu\ndev_write_bytes %lu\n",
+                      sum.dev_rd_ios, sum.dev_rd_bytes, sum.dev_wr_ios, sum.dev_wr_bytes);
+    NEWFS_STATS_PRINT("inode_cache_hits %lu\ninode_cache_misses %lu\ninode_cache_hit_ratio %.4f\n",
+                      sum.icache_hit, sum.icache_miss,
+                      sum.icache_hit + sum.icache_miss ?
+                      (double)sum.icache_hit / (sum.icache_hit + sum.icache_miss) : 0.0);
+    NEWFS_STATS_PRINT("xattr_inline_hits %lu\nxattr_block_lookups %lu\n", sum.xattr_hit, sum.xattr_miss);
+#undef NEWFS_STATS_PRINT
+    return len < size ? len : size - 1;
+}
+
+/**
+ * @brief 生成统计文件的内容，getattr取长度与read取内容共用
+ *
+ * @param len 返回内容长度
+ * @return char* 由调用者free
+ */
+char* newfs_stats_text(int* len) {
+    char* buf = (char *)malloc(NEWFS_STATS_TEXT_SZ);
+    *len = newfs_stats_render(buf, NEWFS_STATS_TEXT_SZ);
+    return buf;
+}
+
+/******************************************************************************
+* SECTION: 计时包装，FUSE操作表经此调用newfs.c中的实现
+*******************************************************************************/
+int newfs_timed_getattr(const char* path, struct stat* newfs_stat) {
+    uint64_t start = newfs_stats_now();
+    int      ret   = newfs_getattr(path, newfs_stat);
+    newfs_stats_op(NEWFS_OP_GETATTR, start);
+    return ret;
+}
+
+int newfs_timed_read(const char* path, char* buf, size_t size, off_t offset, struct fuse_file_info* fi) {
+    uint64_t start = newfs_stats_now();
+    int      ret   = newfs_read(path, buf, size, offset, fi);
+    newfs_stats_op(NEWFS_OP_READ, start);
+    return ret;
+}
+
+int newfs_timed_write(const char* path, const char* buf, size_t size, off_t offset, struct fuse_file_info* fi) {
+    uint64_t start = newfs_stats_now();
+    int      ret   = newfs_write(path, buf, size, offset, fi);
+    newfs_stats_op(NEWFS_OP_WRITE, start);
+    return ret;
+}
+
+int newfs_timed_readdir(const char* path, void* buf, fuse_fill_dir_t filler, off_t offset,
+                        struct fuse_file_info* fi) {
+    uint64_t start = newfs_stats_now();
+    int      ret   = newfs_readdir(path, buf, filler, offset, fi);
+    newfs_stats_op(NEWFS_OP_READDIR, start);
+    return ret;
+}
+
+int newfs_timed_mknod(const char* path, mode_t mode, dev_t dev) {
+    uint64_t start = newfs_stats_now();
+    int      ret   = newfs_mknod(path, mode, dev);
+    newfs_stats_op(NEWFS_OP_MKNOD, start);
+    return ret;
+}
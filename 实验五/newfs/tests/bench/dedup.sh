@@ -0,0 +1,45 @@
+#!/bin/bash
+# 去重基准：在合成的重复语料（模板化配置文件，共享相同的文件头块）上
+# 分别以默认方式与--dedup挂载，比较卸载刷盘耗时与占用的数据块数
+# 用法: ./dedup.sh [文件数, 默认200]
+
+NFILES=${1:-200}
+ROOT_PATH=$(cd "$(dirname "$0")" && pwd)
+NEWFS="$ROOT_PATH"/../../build/newfs
+MNTPOINT="$ROOT_PATH"/mnt
+CORPUS=$(mktemp -d)
+
+GROUPS_CH=(a b c d e f g h)
+# 每个文件4块：2块相同的模板头 + 1块按组重复的正文 + 1块私有尾部
+# 目录最多容纳56个目录项，每50个文件一个子目录
+for ((i = 0; i < 2048; i += 17)); do printf '#config template\n'; done | head -c 2048 > "$CORPUS"/header
+for ((i = 0; i < NFILES; i++)); do
+    FILE="$CORPUS"/d$((i / 50))/f$i
+    mkdir -p "$(dirname "$FILE")"
+    cp "$CORPUS"/header "$FILE"
+    head -c 1024 < /dev/zero | tr '\0' "${GROUPS_CH[i % 8]}" >> "$FILE"
+    printf 'host-%06d\n' "$i" >> "$FILE"
+    head -c $((1024 - 12)) < /dev/zero >> "$FILE"
+done
+
+function used_blocks() {
+    python3 -c "
+import sys
+with open(sys.argv[1], 'rb') as f:
+    f.seek(2048)                                      # NEWFS_MAP_DATA_OFS
+    print(sum(bin(b).count('1') for b in f.read(1024)))" "$HOME"/ddriver
+}
+
+printf '%-10s %12s %12s\n' "mode" "umount(ms)" "data_blocks"
+for MODE in "" "--dedup"; do
+    rm -f ~/ddriver && touch ~/ddriver
+    mkdir -p "$MNTPOINT"
+    "$NEWFS" --device="$HOME"/ddriver $MODE "$MNTPOINT" || exit 1
+    cp -r "$CORPUS"/d* "$MNTPOINT"/
+    START=$(date +%s%N)
+    umount "$MNTPOINT"                                # 数据在卸载时统一刷盘
+    END=$(date +%s%N)
+    printf '%-10s %12d %12d\n' "${MODE:-default}" $(((END - START) / 1000000)) "$(used_blocks)"
+done
+
+rm -rf "$CORPUS" "$MNTPOINT"
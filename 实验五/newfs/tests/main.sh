@@ -3,8 +3,8 @@ POINTS=0
 TOTAL_POINTS=0
 TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh)
 # mount.sh mkdir.sh touch.sh ls.sh remount.sh (read.sh write.sh cp.sh)
-ALL_TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh)
-ALL_TEST_SCORES=(1 4 5 4 16 2 2)
+ALL_TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh rm.sh sparse.sh compress.sh xattr.sh snapshot.sh grow.sh reflink.sh)
+ALL_TEST_SCORES=(1 4 5 4 16 2 2 4 3 3 3 3 3 3)
 MNTPOINT='./mnt'
 PROJECT_NAME="newfs"
 
@@ -35,6 +35,14 @@ elif [[ "${LEVEL}" == "6" ]]; then
     echo "开始mount, mkdir, touch, ls, read&write, cp, umount测试"
     TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh)
     sleep 1
+elif [[ "${LEVEL}" == "7" ]]; then
+    echo "开始mount, mkdir, touch, ls, read&write, cp, rm&mv, umount测试"
+    TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh rm.sh)
+    sleep 1
+elif [[ "${LEVEL}" == "8" ]]; then
+    echo "开始全部基础测试及扩展功能测试"
+    TEST_CASES=(mount.sh mkdir.sh touch.sh ls.sh remount.sh rw.sh cp.sh rm.sh sparse.sh compress.sh xattr.sh snapshot.sh grow.sh reflink.sh)
+    sleep 1
 else
     echo "未知测试参数"
     exit 1
@@ -99,6 +107,12 @@ function mount_fuse() {
     "$ROOT_PATH"/../build/"${PROJECT_NAME}" --device="$HOME"/ddriver "${MNTPOINT}"
 }
 
+# 卸载后重新挂载, 额外参数传给newfs, 如--compress
+function remount_fuse() {
+    clean_mount
+    "$ROOT_PATH"/../build/"${PROJECT_NAME}" --device="$HOME"/ddriver "$@" "${MNTPOINT}"
+}
+
 function check_mount() {
     ABS_MNTPOINT=$(realpath "$MNTPOINT")
     if ! mount | grep "${ABS_MNTPOINT}" >/dev/null; then
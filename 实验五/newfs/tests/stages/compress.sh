@@ -0,0 +1,63 @@
+#!/bin/bash
+
+TEST_CASE="case 10 - compression"
+
+RANDOM_COPY=$(mktemp)
+
+# 8190字节的重复文本, 不超过单个文件的8个数据块
+function make_text () {
+    for _ in $(seq 1 1365); do
+        echo "newfs"
+    done
+}
+
+function check_text () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if ! make_text | cmp -s "$_PARAM" -; then
+        fail "$_TEST_CASE: $_PARAM读出的内容与写入的不一致"
+        return 1
+    fi
+    return 0
+}
+
+function check_compressed () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if (( $(stat -c %b "$_PARAM") >= PLAIN_SECTORS )); then
+        fail "$_TEST_CASE: 不压缩时同样内容占用$PLAIN_SECTORS个扇区, --compress挂载下$_PARAM占用$(stat -c %b "$_PARAM")个, 没有节省数据块"
+        return 1
+    fi
+    if [ "$(stat -c %b "${MNTPOINT}"/random)" != "$PLAIN_SECTORS" ]; then
+        fail "$_TEST_CASE: 随机数据无法压缩, ${MNTPOINT}/random应保持$PLAIN_SECTORS个扇区, 实际$(stat -c %b "${MNTPOINT}"/random)个"
+        return 1
+    fi
+    if ! cmp -s "${MNTPOINT}"/random "$RANDOM_COPY"; then
+        fail "$_TEST_CASE: ${MNTPOINT}/random读出的内容与写入的不一致"
+        return 1
+    fi
+    check_text "$_PARAM" "$_TEST_CASE"
+}
+
+TEST_CASE="case 10.1 - write ${MNTPOINT}/plain without --compress"
+remount_fuse
+make_text > "${MNTPOINT}"/plain
+remount_fuse
+PLAIN_SECTORS=$(stat -c %b "${MNTPOINT}"/plain)
+core_tester echo "${MNTPOINT}"/plain check_text "$TEST_CASE"
+
+TEST_CASE="case 10.2 - write ${MNTPOINT}/text and ${MNTPOINT}/random with --compress"
+remount_fuse --compress
+make_text > "${MNTPOINT}"/text
+head -c 8190 /dev/urandom > "$RANDOM_COPY"
+cp "$RANDOM_COPY" "${MNTPOINT}"/random
+core_tester echo "${MNTPOINT}"/text check_text "$TEST_CASE"
+
+TEST_CASE="case 10.3 - remount with --compress, ${MNTPOINT}/text uses fewer blocks"
+remount_fuse --compress
+core_tester echo "${MNTPOINT}"/text check_compressed "$TEST_CASE"
+
+TEST_CASE="case 10.4 - remount without --compress, read ${MNTPOINT}/text"
+remount_fuse
+core_tester echo "${MNTPOINT}"/text check_text "$TEST_CASE"
+rm -f "$RANDOM_COPY"
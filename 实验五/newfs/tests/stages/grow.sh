@@ -0,0 +1,62 @@
+#!/bin/bash
+
+TEST_CASE="case 13 - grow"
+
+GROW="$ROOT_PATH"/../build/grow.newfs
+BLOCK_SZ=1024
+
+function check_grown () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if [ "$(stat -c %s "$HOME"/ddriver)" != "$_PARAM" ]; then
+        fail "$_TEST_CASE: 扩容后磁盘镜像大小不是$_PARAM字节"
+        return 1
+    fi
+    if (( $(stat -c %b "${MNTPOINT}") <= BLOCKS_BEFORE )); then
+        fail "$_TEST_CASE: 扩容到$_PARAM字节后${MNTPOINT}的块数没有增加"
+        return 1
+    fi
+    if [ "$(stat -c %b "${MNTPOINT}")" != "$(( _PARAM / BLOCK_SZ ))" ]; then
+        fail "$_TEST_CASE: 扩容到$_PARAM字节后${MNTPOINT}应有$(( _PARAM / BLOCK_SZ ))个块, 实际$(stat -c %b "${MNTPOINT}")个"
+        return 1
+    fi
+    if [ "$(cat "${MNTPOINT}"/before_grow)" != "kept" ]; then
+        fail "$_TEST_CASE: 扩容后${MNTPOINT}/before_grow的内容丢失"
+        return 1
+    fi
+    return 0
+}
+
+function check_persist () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if [ "$(stat -c %b "${MNTPOINT}")" != "$BLOCKS_GROWN" ]; then
+        fail "$_TEST_CASE: 重新挂载后${MNTPOINT}的块数与扩容后不一致"
+        return 1
+    fi
+    if [ "$(cat "${MNTPOINT}"/before_grow)" != "kept" ]; then
+        fail "$_TEST_CASE: 重新挂载后${MNTPOINT}/before_grow的内容丢失"
+        return 1
+    fi
+    return 0
+}
+
+try_mount_or_fail
+
+TEST_CASE="case 13.1 - grow.newfs -m ${MNTPOINT} 8M"
+echo "kept" > "${MNTPOINT}"/before_grow
+BLOCKS_BEFORE=$(stat -c %b "${MNTPOINT}")
+"$GROW" -m "${MNTPOINT}" 8M
+core_tester echo 8388608 check_grown "$TEST_CASE"
+
+TEST_CASE="case 13.2 - remount after online grow"
+BLOCKS_GROWN=$(stat -c %b "${MNTPOINT}")
+remount_fuse
+core_tester echo "$TEST_CASE" check_persist "$TEST_CASE"
+
+TEST_CASE="case 13.3 - umount, grow.newfs 12M, mount"
+BLOCKS_BEFORE=$BLOCKS_GROWN
+clean_mount
+"$GROW" 12M
+try_mount_or_fail
+core_tester echo 12582912 check_grown "$TEST_CASE"
@@ -0,0 +1,59 @@
+#!/bin/bash
+
+TEST_CASE="case 14 - reflink clone"
+
+BLOCK_SZ=1024
+
+# 3000字节, 占用源文件的3个数据块
+function make_source () {
+    printf 's%.0s' $(seq 1 3000)
+}
+
+function check_clone () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if ! make_source | cmp -s "$_PARAM" -; then
+        fail "$_TEST_CASE: 克隆得到的$_PARAM内容与源文件不一致"
+        return 1
+    fi
+    if [ "$(stat -c %s "${MNTPOINT}")" != "$USAGE_BEFORE" ]; then
+        fail "$_TEST_CASE: 克隆应与源文件共享数据块, 但${MNTPOINT}已用空间增加了$(( $(stat -c %s "${MNTPOINT}") - USAGE_BEFORE ))字节"
+        return 1
+    fi
+    return 0
+}
+
+function check_cow () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if [ "$(head -c 4 "${MNTPOINT}"/src)" != "XXss" ]; then
+        fail "$_TEST_CASE: 写入源文件${MNTPOINT}/src后内容不正确"
+        return 1
+    fi
+    if ! make_source | cmp -s "$_PARAM" -; then
+        fail "$_TEST_CASE: 写入源文件后克隆得到的$_PARAM也被修改, 共享的数据块没有写时复制"
+        return 1
+    fi
+    if [ "$(stat -c %s "${MNTPOINT}")" != "$(( USAGE_BEFORE + BLOCK_SZ ))" ]; then
+        fail "$_TEST_CASE: 写入共享的第一个数据块应只复制该块, 但${MNTPOINT}已用空间增加了$(( $(stat -c %s "${MNTPOINT}") - USAGE_BEFORE ))字节"
+        return 1
+    fi
+    return 0
+}
+
+try_mount_or_fail
+
+TEST_CASE="case 14.1 - setfattr -n user.newfs.clone -v /src ${MNTPOINT}/clone"
+make_source > "${MNTPOINT}"/src
+touch_and_check "${MNTPOINT}"/clone
+USAGE_BEFORE=$(stat -c %s "${MNTPOINT}")
+setfattr -n user.newfs.clone -v /src "${MNTPOINT}"/clone
+core_tester echo "${MNTPOINT}"/clone check_clone "$TEST_CASE"
+
+TEST_CASE="case 14.2 - write ${MNTPOINT}/src, ${MNTPOINT}/clone unchanged"
+echo -n "XX" | dd of="${MNTPOINT}"/src conv=notrunc 2>/dev/null
+core_tester echo "${MNTPOINT}"/clone check_cow "$TEST_CASE"
+
+TEST_CASE="case 14.3 - remount, ${MNTPOINT}/clone unchanged"
+remount_fuse
+core_tester echo "${MNTPOINT}"/clone check_cow "$TEST_CASE"
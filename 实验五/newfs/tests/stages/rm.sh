@@ -0,0 +1,65 @@
+#!/bin/bash
+
+TEST_CASE="case 8 - remove & rename"
+
+function check_rm () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if stat "$_PARAM" > /dev/null 2>&1; then
+        fail "$_TEST_CASE: 删除$_PARAM后仍然可以stat"
+        return 1
+    fi 
+    return 0
+}
+
+function check_mv () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if stat "${MNTPOINT}"/file0 > /dev/null 2>&1; then
+        fail "$_TEST_CASE: 重命名后源文件${MNTPOINT}/file0仍然存在"
+        return 1
+    fi 
+    if ! stat "$_PARAM" > /dev/null; then
+        fail "$_TEST_CASE: 重命名后目标文件$_PARAM不存在"
+        return 1
+    fi 
+    return 0
+}
+
+function check_churn () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    for round in $(seq 1 20); do
+        mkdir "${MNTPOINT}"/churn || return 1
+        for i in $(seq 1 20); do
+            if ! echo "$round-$i" > "${MNTPOINT}"/churn/file"$i"; then
+                fail "$_TEST_CASE: 第$round轮写入${MNTPOINT}/churn/file$i失败, inode或数据块没有被回收"
+                return 1
+            fi
+        done
+        if ! rm -r "${MNTPOINT}"/churn; then
+            fail "$_TEST_CASE: 第$round轮删除${MNTPOINT}/churn失败"
+            return 1
+        fi
+    done
+    return 0
+}
+
+try_mount_or_fail
+
+TEST_CASE="case 8.1 - rm ${MNTPOINT}/file1"
+touch_and_check "${MNTPOINT}"/file1
+core_tester rm "${MNTPOINT}"/file1 check_rm "$TEST_CASE"
+
+TEST_CASE="case 8.2 - mv ${MNTPOINT}/file0 ${MNTPOINT}/dir0/file3"
+touch_and_check "${MNTPOINT}"/file0
+mkdir_and_check "${MNTPOINT}"/dir0
+mv "${MNTPOINT}"/file0 "${MNTPOINT}"/dir0/file3
+core_tester echo "${MNTPOINT}"/dir0/file3 check_mv "$TEST_CASE"
+
+TEST_CASE="case 8.3 - rm -r ${MNTPOINT}/dir0"
+rm -r "${MNTPOINT}"/dir0
+core_tester echo "${MNTPOINT}"/dir0 check_rm "$TEST_CASE"
+
+TEST_CASE="case 8.4 - create & remove churn"
+core_tester echo "$TEST_CASE" check_churn "$TEST_CASE"
@@ -0,0 +1,82 @@
+#!/bin/bash
+
+TEST_CASE="case 12 - snapshot"
+
+function check_live () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if [ "$(cat "$_PARAM")" != "v2" ]; then
+        fail "$_TEST_CASE: 活动文件系统中的$_PARAM内容应为v2"
+        return 1
+    fi
+    if [ -e "${MNTPOINT}"/snapgone ]; then
+        fail "$_TEST_CASE: 活动文件系统中已删除的${MNTPOINT}/snapgone仍然存在"
+        return 1
+    fi
+    return 0
+}
+
+function check_listed () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if ! ls "$_PARAM" | grep -qx s1; then
+        fail "$_TEST_CASE: $_PARAM中没有列出快照s1"
+        return 1
+    fi
+    check_live "${MNTPOINT}"/snapfile "$_TEST_CASE"
+}
+
+function check_snapshot () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if [ "$(cat "$_PARAM")" != "v1" ]; then
+        fail "$_TEST_CASE: 快照中的$_PARAM内容随活动文件改变, 应为v1"
+        return 1
+    fi
+    if [ "$(cat "${MNTPOINT}"/snapgone 2>/dev/null)" != "gone" ]; then
+        fail "$_TEST_CASE: 快照后在活动文件系统中删除的${MNTPOINT}/snapgone在快照中也丢失了"
+        return 1
+    fi
+    if echo "v3" > "$_PARAM" 2>/dev/null; then
+        fail "$_TEST_CASE: 快照应以只读方式挂载, 但写入$_PARAM成功"
+        return 1
+    fi
+    if touch "${MNTPOINT}"/snapnew 2>/dev/null; then
+        fail "$_TEST_CASE: 快照应以只读方式挂载, 但创建${MNTPOINT}/snapnew成功"
+        return 1
+    fi
+    return 0
+}
+
+function check_deleted () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if ls "$_PARAM" | grep -qx s1; then
+        fail "$_TEST_CASE: rmdir后$_PARAM中仍然列出快照s1"
+        return 1
+    fi
+    check_live "${MNTPOINT}"/snapfile "$_TEST_CASE"
+}
+
+try_mount_or_fail
+
+TEST_CASE="case 12.1 - mkdir ${MNTPOINT}/.snapshots/s1"
+echo "v1" > "${MNTPOINT}"/snapfile
+echo "gone" > "${MNTPOINT}"/snapgone
+mkdir "${MNTPOINT}"/.snapshots/s1
+echo "v2" > "${MNTPOINT}"/snapfile
+rm "${MNTPOINT}"/snapgone
+core_tester echo "${MNTPOINT}"/.snapshots check_listed "$TEST_CASE"
+
+TEST_CASE="case 12.2 - mount --snapshot=s1, ${MNTPOINT}/snapfile unchanged"
+remount_fuse --snapshot=s1
+core_tester echo "${MNTPOINT}"/snapfile check_snapshot "$TEST_CASE"
+
+TEST_CASE="case 12.3 - remount the live tree, read ${MNTPOINT}/snapfile"
+remount_fuse
+core_tester echo "${MNTPOINT}"/snapfile check_live "$TEST_CASE"
+
+TEST_CASE="case 12.4 - rmdir ${MNTPOINT}/.snapshots/s1"
+rmdir "${MNTPOINT}"/.snapshots/s1
+remount_fuse
+core_tester echo "${MNTPOINT}"/.snapshots check_deleted "$TEST_CASE"
@@ -0,0 +1,82 @@
+#!/bin/bash
+
+TEST_CASE="case 9 - sparse file"
+
+# 每个数据块1024字节, stat -c %b按512字节扇区计
+BLOCK_SECTORS=2
+
+function check_hole () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if [ "$(stat -c %s "$_PARAM")" != "8192" ]; then
+        fail "$_TEST_CASE: truncate后$_PARAM大小不是8192"
+        return 1
+    fi
+    if [ "$(stat -c %b "$_PARAM")" != "0" ]; then
+        fail "$_TEST_CASE: truncate扩展出的空洞不应占用数据块, 实际占用$(stat -c %b "$_PARAM")个扇区"
+        return 1
+    fi
+    return 0
+}
+
+function check_fill () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if [ "$(stat -c %s "$_PARAM")" != "8192" ]; then
+        fail "$_TEST_CASE: 在空洞中写入后$_PARAM大小发生变化"
+        return 1
+    fi
+    if [ "$(stat -c %b "$_PARAM")" != "$BLOCK_SECTORS" ]; then
+        fail "$_TEST_CASE: 在空洞中写入4字节应只分配1个数据块($BLOCK_SECTORS个扇区), 实际占用$(stat -c %b "$_PARAM")个扇区"
+        return 1
+    fi
+    return 0
+}
+
+function check_remount_hole () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if ! cmp -s -n 4096 "$_PARAM" /dev/zero; then
+        fail "$_TEST_CASE: 重新挂载后$_PARAM的空洞部分读出的不是0"
+        return 1
+    fi
+    if [ "$(dd if="$_PARAM" bs=1024 skip=4 count=1 2>/dev/null | head -c 4)" != "data" ]; then
+        fail "$_TEST_CASE: 重新挂载后$_PARAM在4096处的数据丢失"
+        return 1
+    fi
+    check_fill "$_PARAM" "$_TEST_CASE"
+}
+
+function check_shrink () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if [ "$(stat -c %b "$_PARAM")" != "0" ]; then
+        fail "$_TEST_CASE: 截短到4096后$_PARAM在4096处的数据块没有释放, 仍占用$(stat -c %b "$_PARAM")个扇区"
+        return 1
+    fi
+    if [ "$(stat -c %s "${MNTPOINT}")" != "$USAGE_HOLE" ]; then
+        fail "$_TEST_CASE: 截短后${MNTPOINT}已用空间没有回到写入前的$USAGE_HOLE字节"
+        return 1
+    fi
+    return 0
+}
+
+try_mount_or_fail
+
+TEST_CASE="case 9.1 - truncate -s 8192 ${MNTPOINT}/sparse"
+touch_and_check "${MNTPOINT}"/sparse
+truncate -s 8192 "${MNTPOINT}"/sparse
+core_tester echo "${MNTPOINT}"/sparse check_hole "$TEST_CASE"
+
+TEST_CASE="case 9.2 - write into the hole of ${MNTPOINT}/sparse"
+USAGE_HOLE=$(stat -c %s "${MNTPOINT}")
+echo -n "data" | dd of="${MNTPOINT}"/sparse bs=1024 seek=4 conv=notrunc 2>/dev/null
+core_tester echo "${MNTPOINT}"/sparse check_fill "$TEST_CASE"
+
+TEST_CASE="case 9.3 - remount and read ${MNTPOINT}/sparse"
+remount_fuse
+core_tester echo "${MNTPOINT}"/sparse check_remount_hole "$TEST_CASE"
+
+TEST_CASE="case 9.4 - truncate -s 4096 ${MNTPOINT}/sparse"
+truncate -s 4096 "${MNTPOINT}"/sparse
+core_tester echo "${MNTPOINT}"/sparse check_shrink "$TEST_CASE"
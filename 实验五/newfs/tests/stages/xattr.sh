@@ -0,0 +1,80 @@
+#!/bin/bash
+
+TEST_CASE="case 11 - extended attributes"
+
+# inode内联xattr区只有64字节, 200字节的值必须放进单独的xattr块
+BIG_VALUE=$(printf 'x%.0s' $(seq 1 200))
+BLOCK_SZ=1024
+
+function check_inline () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if [ "$(getfattr --only-values -n user.small "$_PARAM" 2>/dev/null)" != "1" ]; then
+        fail "$_TEST_CASE: 读出的$_PARAM扩展属性user.small与写入的不一致"
+        return 1
+    fi
+    if [ "$(stat -c %s "${MNTPOINT}")" != "$USAGE_BEFORE" ]; then
+        fail "$_TEST_CASE: user.small应存放在inode内联区, 但${MNTPOINT}已用空间增加了$(( $(stat -c %s "${MNTPOINT}") - USAGE_BEFORE ))字节"
+        return 1
+    fi
+    return 0
+}
+
+function check_spill () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if [ "$(getfattr --only-values -n user.big "$_PARAM" 2>/dev/null)" != "$BIG_VALUE" ]; then
+        fail "$_TEST_CASE: 读出的$_PARAM扩展属性user.big与写入的不一致"
+        return 1
+    fi
+    if [ "$(stat -c %s "${MNTPOINT}")" != "$(( USAGE_BEFORE + BLOCK_SZ ))" ]; then
+        fail "$_TEST_CASE: user.big放不进内联区, 应分配1个xattr块, 但${MNTPOINT}已用空间增加了$(( $(stat -c %s "${MNTPOINT}") - USAGE_BEFORE ))字节"
+        return 1
+    fi
+    check_inline_value "$_PARAM" "$_TEST_CASE"
+}
+
+function check_inline_value () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if [ "$(getfattr --only-values -n user.small "$_PARAM" 2>/dev/null)" != "1" ]; then
+        fail "$_TEST_CASE: 读出的$_PARAM扩展属性user.small与写入的不一致"
+        return 1
+    fi
+    return 0
+}
+
+function check_removed () {
+    _PARAM=$1
+    _TEST_CASE=$2
+    if getfattr -n user.big "$_PARAM" > /dev/null 2>&1; then
+        fail "$_TEST_CASE: 删除后仍然可以读出$_PARAM的扩展属性user.big"
+        return 1
+    fi
+    if [ "$(stat -c %s "${MNTPOINT}")" != "$USAGE_BEFORE" ]; then
+        fail "$_TEST_CASE: 删除xattr块中唯一的属性后该块没有释放, ${MNTPOINT}已用空间多出$(( $(stat -c %s "${MNTPOINT}") - USAGE_BEFORE ))字节"
+        return 1
+    fi
+    check_inline_value "$_PARAM" "$_TEST_CASE"
+}
+
+try_mount_or_fail
+
+TEST_CASE="case 11.1 - setfattr -n user.small ${MNTPOINT}/attr, stored inline"
+touch_and_check "${MNTPOINT}"/attr
+USAGE_BEFORE=$(stat -c %s "${MNTPOINT}")
+setfattr -n user.small -v 1 "${MNTPOINT}"/attr
+core_tester echo "${MNTPOINT}"/attr check_inline "$TEST_CASE"
+
+TEST_CASE="case 11.2 - setfattr -n user.big ${MNTPOINT}/attr, spills to the xattr block"
+setfattr -n user.big -v "$BIG_VALUE" "${MNTPOINT}"/attr
+core_tester echo "${MNTPOINT}"/attr check_spill "$TEST_CASE"
+
+TEST_CASE="case 11.3 - remount and getfattr ${MNTPOINT}/attr"
+remount_fuse
+core_tester echo "${MNTPOINT}"/attr check_spill "$TEST_CASE"
+
+TEST_CASE="case 11.4 - setfattr -x user.big ${MNTPOINT}/attr, xattr block freed"
+setfattr -x user.big "${MNTPOINT}"/attr
+remount_fuse
+core_tester echo "${MNTPOINT}"/attr check_removed "$TEST_CASE"
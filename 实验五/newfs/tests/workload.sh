@@ -0,0 +1,168 @@
+#!/bin/bash
+# 挂载态负载套件：在FUSE挂载的newfs上运行接近真实场景的混合负载，
+# 每个阶段记录吞吐与尾延迟并输出为JSON，便于逐版本比较
+# 用法: ./workload.sh [输出文件, 默认workload.json] [newfs额外挂载参数...]
+#
+# 阶段: create_storm  批量建目录与空文件
+#       small_read    小文件随机读为主
+#       append_log    多个日志文件交替追加
+#       tree_walk     深层目录树的遍历（find + stat）
+#       cp_tree       cp -r 拷入一棵目录树
+# 单目录最多56项、单文件最多8KB，各阶段规模按此设置
+
+OUTPUT=${1:-workload.json}
+shift
+MOUNT_OPTS=("$@")
+ROOT_PATH=$(cd "$(dirname "$0")" && pwd)
+NEWFS="$ROOT_PATH"/../build/newfs
+MNTPOINT="$ROOT_PATH"/mnt
+SCRATCH=$(mktemp -d)
+PHASES=()
+
+function now_us() {
+    echo "${EPOCHREALTIME/./}"
+}
+
+function check_mount() {
+    mount | grep "$(realpath "$MNTPOINT")" >/dev/null
+}
+
+function mount_newfs() {
+    rm -f ~/ddriver && touch ~/ddriver
+    mkdir -p "$MNTPOINT"
+    "$NEWFS" --device="$HOME"/ddriver "${MOUNT_OPTS[@]}" "$MNTPOINT" || exit 1
+    check_mount || { echo "mount failed"; exit 1; }
+}
+
+function umount_newfs() {
+    while check_mount; do
+        umount "$MNTPOINT"
+    done
+}
+
+# timed <延迟文件> <命令...>：执行一次操作并记录其延迟（微秒）
+function timed() {
+    local lat=$1 start
+    shift
+    start=$(now_us)
+    "$@" >/dev/null || { echo "op failed: $*"; umount_newfs; exit 1; }
+    echo $(($(now_us) - start)) >> "$lat"
+}
+
+# record <阶段名> <延迟文件> <阶段耗时us> <处理的项数>
+function record() {
+    local name=$1 lat=$2 elapsed=$3 items=$4 n p50 p99 rate
+    n=$(wc -l < "$lat")
+    p50=$(sort -n "$lat" | sed -n "$(((n - 1) * 50 / 100 + 1))p")
+    p99=$(sort -n "$lat" | sed -n "$(((n - 1) * 99 / 100 + 1))p")
+    rate=$(awk -v i="$items" -v e="$elapsed" 'BEGIN { printf "%.1f", i * 1000000 / e }')
+    PHASES+=("$(printf '{"name": "%s", "ops": %d, "items": %d, "seconds": %s, "items_per_sec": %s, "p50_us": %d, "p99_us": %d}' \
+        "$name" "$n" "$items" "$(awk -v e="$elapsed" 'BEGIN { printf "%.6f", e / 1000000 }')" \
+        "$rate" "$p50" "$p99")")
+    printf '%-14s %8d %12s %10d %10d\n' "$name" "$items" "$rate" "$p50" "$p99"
+}
+
+# run_phase <阶段名> <项数> <函数>：函数内以timed记录每个操作
+function run_phase() {
+    local name=$1 items=$2 fn=$3 lat="$SCRATCH/$1.lat" start
+    : > "$lat"
+    start=$(now_us)
+    $fn "$lat"
+    record "$name" "$lat" $(($(now_us) - start)) "$items"
+}
+
+function create_storm() {
+    for ((d = 0; d < 10; d++)); do
+        timed "$1" mkdir "$MNTPOINT"/storm/d$d
+        for ((f = 0; f < 50; f++)); do
+            timed "$1" touch "$MNTPOINT"/storm/d$d/f$f
+        done
+    done
+}
+
+function small_read() {
+    for ((i = 0; i < 1000; i++)); do
+        timed "$1" cat "$MNTPOINT"/small/d$((RANDOM % 2))/f$((RANDOM % 50))
+    done
+}
+
+function append_log() {
+    local line
+    line=$(printf '%0127d' 0)
+    for ((i = 0; i < 64; i++)); do
+        for ((f = 0; f < 8; f++)); do
+            timed "$1" eval "echo \"$line\" >> \"$MNTPOINT\"/log/app$f.log"
+        done
+    done
+}
+
+function tree_walk() {
+    for ((i = 0; i < 5; i++)); do
+        timed "$1" find "$MNTPOINT"/tree -exec stat -c %s {} +
+    done
+}
+
+function cp_tree() {
+    for ((i = 0; i < 3; i++)); do
+        timed "$1" cp -r "$SCRATCH"/src "$MNTPOINT"/copy$i
+    done
+}
+
+# 准备阶段：小文件、目录树与待拷贝的本地源树，不计入结果
+function prepare() {
+    mkdir "$MNTPOINT"/storm "$MNTPOINT"/small "$MNTPOINT"/log "$MNTPOINT"/tree
+    for ((d = 0; d < 2; d++)); do
+        mkdir "$MNTPOINT"/small/d$d
+        for ((f = 0; f < 50; f++)); do
+            head -c 2048 /dev/urandom > "$MNTPOINT"/small/d$d/f$f
+        done
+    done
+    for ((leaf = 0; leaf < 64; leaf++)); do          # 深度6的二叉目录树，外加一条16层的长链
+        DIR="$MNTPOINT"/tree
+        for ((bit = 5; bit >= 0; bit--)); do
+            DIR="$DIR"/$(((leaf >> bit) & 1))
+        done
+        mkdir -p "$DIR"
+    done
+    mkdir -p "$MNTPOINT"/tree/chain/$(printf 'l%d/' $(seq 1 16))
+    TREE_ENTRIES=$(find "$MNTPOINT"/tree | wc -l)
+    for ((d = 0; d < 4; d++)); do
+        mkdir -p "$SCRATCH"/src/sub$d/deep
+        for ((f = 0; f < 20; f++)); do
+            head -c $((512 * (f % 8 + 1))) /dev/urandom > "$SCRATCH"/src/sub$d/f$f
+        done
+        head -c 4096 /dev/urandom > "$SCRATCH"/src/sub$d/deep/blob
+    done
+    CP_ENTRIES=$(find "$SCRATCH"/src | wc -l)
+}
+
+umount_newfs
+mount_newfs
+prepare
+printf '%-14s %8s %12s %10s %10s\n' "phase" "items" "items/sec" "p50_us" "p99_us"
+run_phase create_storm 510 create_storm
+run_phase small_read 1000 small_read
+run_phase append_log 512 append_log
+run_phase tree_walk $((TREE_ENTRIES * 5)) tree_walk
+run_phase cp_tree $((CP_ENTRIES * 3)) cp_tree
+
+if ! diff -r "$SCRATCH"/src "$MNTPOINT"/copy0 >/dev/null; then
+    echo "cp_tree: copied tree differs from source"
+    umount_newfs
+    exit 1
+fi
+umount_newfs
+
+{
+    printf '{\n  "timestamp": "%s",\n  "commit": "%s",\n  "mount_opts": "%s",\n  "phases": [\n' \
+        "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$(git -C "$ROOT_PATH" rev-parse --short HEAD 2>/dev/null)" \
+        "${MOUNT_OPTS[*]}"
+    for ((i = 0; i < ${#PHASES[@]}; i++)); do
+        printf '    %s%s\n' "${PHASES[i]}" "$([[ $i -lt $((${#PHASES[@]} - 1)) ]] && echo ,)"
+    done
+    printf '  ]\n}\n'
+} > "$OUTPUT"
+echo "results written to $OUTPUT"
+
+rm -rf "$SCRATCH"
+rmdir "$MNTPOINT" 2>/dev/null
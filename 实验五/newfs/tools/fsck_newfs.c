@@ -0,0 +1,597 @@
+#include "newfs.h"
+#include <getopt.h>
+#include <stdarg.h>
+
+/******************************************************************************
+* SECTION: fsck.newfs
+*
+* 直接读取磁盘镜像（~/ddriver），布局取自超级块。检查分四个阶段：
+*   1. 按inode号区间多线程读入位图中已分配的inode及其目录项
+*   2. 从根目录及各快照根在内存中遍历，确定可达inode与类型不一致
+*   3. 按inode号区间多线程统计每个数据块的引用数，核对inode位图与共享计数表
+*   4. 按数据块区间多线程核对data位图、引用计数表，可选核对校验和
+* 各线程负责的区间按8对齐，修复位图时互不写同一字节。
+* 默认只读，可对已挂载的镜像运行（newfs卸载时才刷盘，结果反映上次卸载的状态）；
+* -r 修复泄漏的inode/数据块、位图与引用计数不一致以及越界块号，须在卸载后运行。
+*******************************************************************************/
+#define FSCK_EXIT_OK            0
+#define FSCK_EXIT_FIXED         1
+#define FSCK_EXIT_UNCORRECTED   4
+#define FSCK_EXIT_OPERATIONAL   8
+#define FSCK_MAX_THREADS        64
+
+#define FSCK_E_READ             0x01            /* inode记录读失败 */
+#define FSCK_E_RECORD           0x02            /* ino或类型不符 */
+#define FSCK_E_PTR              0x04            /* 块号越界，已在内存中置为-1 */
+#define FSCK_E_DIR_CNT          0x08            /* 目录项数越界 */
+#define FSCK_E_DENTRY_BLK       0x10            /* 目录块缺失或读失败 */
+#define FSCK_E_DENTRY_INO       0x20            /* 目录项指向越界inode */
+
+#define FSCK_BIT_TEST(map, i)   ((map)[(i) / UINT8_BITS] & (0x1 << ((i) % UINT8_BITS)))
+#define FSCK_BIT_SET(map, i)    ((map)[(i) / UINT8_BITS] |= (0x1 << ((i) % UINT8_BITS)))
+#define FSCK_BIT_CLR(map, i)    ((map)[(i) / UINT8_BITS] &= ~(0x1 << ((i) % UINT8_BITS)))
+
+struct fsck_inode {
+    struct newfs_inode_d d;                         // 磁盘上的inode记录
+    int*                 child;                     // 目录项指向的inode号
+    uint8_t*             child_ftype;               // 目录项中记录的文件类型
+    int                  nchild;
+    bool                 loaded;
+    bool                 bad;                       // 记录无法解析，不再向下检查
+    bool                 reachable;
+    bool                 dirty;                     // 记录已修复，需写回
+    int                  err;                       // FSCK_E_*，读入时发现的问题
+    int                  links;                     // 指向该inode的目录项数，与快照共享时为共享计数 + 1
+};
+
+struct fsck_range {
+    int                  lo;
+    int                  hi;
+    void               (*fn)(int, int);
+};
+
+static int                  fsck_fd = -1;
+static struct newfs_super_d fsck_super;
+static uint8_t*             fsck_map_inode;
+static uint8_t*             fsck_map_data;
+static uint8_t*             fsck_map_ref;
+static uint32_t*            fsck_map_csum;
+static uint8_t*             fsck_map_iref;
+static struct fsck_inode*   fsck_inodes;
+static uint32_t*            fsck_refs;               // 每个数据块被引用的次数
+static int                  fsck_threads   = 1;
+static bool                 fsck_repair    = false;
+static bool                 fsck_csum      = false;
+static bool                 fsck_verbose   = false;
+static int                  fsck_fixed     = 0;
+static int                  fsck_left      = 0;
+static bool                 fsck_maps_dirty = false;
+static pthread_mutex_t      fsck_report_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief 报告一个问题并计数
+ *
+ * @param fixable 该问题在-r下会被修复
+ * @param fmt
+ * @param ...
+ */
+__attribute__((format(printf, 2, 3)))
+static void fsck_problem(bool fixable, const char* fmt, ...) {
+    va_list args;
+    pthread_mutex_lock(&fsck_report_lock);
+    if (fixable && fsck_repair) {
+        fsck_fixed++;
+    }
+    else {
+        fsck_left++;
+    }
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    printf(fixable ? (fsck_repair ? " [fixed]\n" : " [fixable with -r]\n") : "\n");
+    pthread_mutex_unlock(&fsck_report_lock);
+}
+
+static int fsck_read(off_t offset, void* buf, int size) {
+    return pread(fsck_fd, buf, size, offset) == size ? NEWFS_ERROR_NONE : -NEWFS_ERROR_IO;
+}
+
+static int fsck_write(off_t offset, const void* buf, int size) {
+    return pwrite(fsck_fd, buf, size, offset) == size ? NEWFS_ERROR_NONE : -NEWFS_ERROR_IO;
+}
+
+static off_t fsck_data_ofs(int blk) {
+    return (off_t)fsck_super.data_offset + (off_t)blk * NEWFS_DATA_SIZE;
+}
+
+static off_t fsck_inode_ofs(int ino) {
+    return (off_t)fsck_super.inode_offset + (off_t)ino * NEWFS_INODE_SIZE;
+}
+
+/**
+ * @brief 把[0, max)切成按8对齐的区间，每个线程处理一段
+ *
+ * @param max
+ * @param fn 处理[lo, hi)的函数
+ */
+static void* fsck_range_worker(void* arg) {
+    struct fsck_range* range = (struct fsck_range *)arg;
+    range->fn(range->lo, range->hi);
+    return NULL;
+}
+
+static void fsck_parallel(int max, void (*fn)(int, int)) {
+    pthread_t         threads[FSCK_MAX_THREADS];
+    struct fsck_range ranges[FSCK_MAX_THREADS];
+    int               per = NEWFS_ROUND_UP((max + fsck_threads - 1) / fsck_threads, UINT8_BITS);
+    bool              started[FSCK_MAX_THREADS];
+    int               n   = 0;
+    for (int lo = 0; lo < max; lo += per, n++) {
+        ranges[n].lo = lo;
+        ranges[n].hi = lo + per < max ? lo + per : max;
+        ranges[n].fn = fn;
+        started[n]   = pthread_create(&threads[n], NULL, fsck_range_worker, &ranges[n]) == 0;
+        if (!started[n]) {                            /* 建线程失败时在当前线程处理 */
+            fsck_range_worker(&ranges[n]);
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+/**
+ * @brief 读入一个inode记录，目录还读入其全部目录项。
+ * 此时尚不知道inode是否可达（泄漏的inode可能留有过期记录），
+ * 发现的问题只记在err中，由fsck_check_inode对可达inode报告
+ *
+ * @param ino
+ */
+static void fsck_load_inode(int ino) {
+    struct fsck_inode*     inode = &fsck_inodes[ino];
+    struct newfs_inode_d*  d     = &inode->d;
+    struct newfs_dentry_d* dentry_d;
+    uint8_t                blk_buf[NEWFS_DATA_SIZE];
+    int                    cur_blk = -1, blk_idx;
+
+    inode->loaded = true;
+    if (fsck_read(fsck_inode_ofs(ino), d, sizeof(struct newfs_inode_d)) != NEWFS_ERROR_NONE) {
+        inode->err |= FSCK_E_READ;
+        inode->bad  = true;
+        return;
+    }
+    if (d->ino != ino || (d->ftype != NEWFS_FILE && d->ftype != NEWFS_DIR && d->ftype != NEWFS_SYM_LINK)) {
+        inode->err |= FSCK_E_RECORD;
+        inode->bad  = true;
+        return;
+    }
+    for (int i = 0; i < NEWFS_DATA_PER_FILE; i++) {
+        if (d->block_pointer[i] < -1 || d->block_pointer[i] >= fsck_super.max_data) {
+            d->block_pointer[i] = -1;                 /* 修复后写回 */
+            inode->err         |= FSCK_E_PTR;
+        }
+    }
+    if (d->xattr_blk < -1 || d->xattr_blk >= fsck_super.max_data) {
+        d->xattr_blk = -1;
+        inode->err  |= FSCK_E_PTR;
+    }
+    if (d->ftype != NEWFS_DIR) {
+        return;
+    }
+    if (d->dir_cnt < 0 || d->dir_cnt > (int)(NEWFS_DENTRY_PER_BLK() * NEWFS_DATA_PER_FILE)) {
+        inode->err |= FSCK_E_DIR_CNT;
+        inode->bad  = true;
+        return;
+    }
+    inode->child       = (int *)malloc(d->dir_cnt * sizeof(int) + 1);
+    inode->child_ftype = (uint8_t *)malloc(d->dir_cnt + 1);
+    for (int i = 0; i < d->dir_cnt; i++) {
+        blk_idx = i / NEWFS_DENTRY_PER_BLK();
+        if (blk_idx != cur_blk) {
+            if (d->block_pointer[blk_idx] < 0 ||
+                fsck_read(fsck_data_ofs(d->block_pointer[blk_idx]), blk_buf, NEWFS_DATA_SIZE) != NEWFS_ERROR_NONE) {
+                inode->err |= FSCK_E_DENTRY_BLK;
+                break;
+            }
+            cur_blk = blk_idx;
+        }
+        dentry_d = (struct newfs_dentry_d *)(blk_buf + (i % NEWFS_DENTRY_PER_BLK()) * sizeof(struct newfs_dentry_d));
+        if (dentry_d->ino <= 0 || dentry_d->ino >= fsck_super.max_ino) {
+            inode->err |= FSCK_E_DENTRY_INO;
+            continue;
+        }
+        inode->child[inode->nchild]       = dentry_d->ino;
+        inode->child_ftype[inode->nchild] = (uint8_t)dentry_d->ftype;
+        inode->nchild++;
+    }
+}
+
+/**
+ * @brief 报告可达inode的问题
+ *
+ * @param ino
+ */
+static void fsck_check_inode(int ino) {
+    struct fsck_inode*    inode = &fsck_inodes[ino];
+    struct newfs_inode_d* d     = &inode->d;
+    int                   need  = 0;
+
+    if (inode->err & FSCK_E_READ) {
+        fsck_problem(false, "inode %d: read error", ino);
+    }
+    if (inode->err & FSCK_E_RECORD) {
+        fsck_problem(false, "inode %d: bad record (ino %d, ftype %d)", ino, d->ino, d->ftype);
+    }
+    if (inode->err & FSCK_E_PTR) {
+        fsck_problem(true, "inode %d: block pointer out of range", ino);
+        inode->dirty = true;
+    }
+    if (inode->err & FSCK_E_DIR_CNT) {
+        fsck_problem(false, "inode %d: bad dentry count %d", ino, d->dir_cnt);
+    }
+    if (inode->err & FSCK_E_DENTRY_BLK) {
+        fsck_problem(false, "inode %d: dentry block missing or unreadable, %d of %d entries lost",
+                     ino, d->dir_cnt - inode->nchild, d->dir_cnt);
+    }
+    if (inode->err & FSCK_E_DENTRY_INO) {
+        fsck_problem(false, "inode %d: directory entry points to an invalid inode", ino);
+    }
+    if (inode->bad) {
+        return;
+    }
+    if (d->ftype == NEWFS_DIR) {
+        if (d->flags & NEWFS_INODE_COMPRESSED) {
+            fsck_problem(false, "inode %d: directory marked compressed", ino);
+        }
+        return;
+    }
+    if (d->size < 0 || d->size > NEWFS_DATA_PER_FILE * NEWFS_DATA_SIZE) {
+        fsck_problem(false, "inode %d: bad size %d", ino, d->size);
+    }
+    if (d->flags & NEWFS_INODE_COMPRESSED) {          /* 压缩数据存放在前csize字节对应的块中 */
+        if (d->csize <= 0 || d->csize > NEWFS_DATA_PER_FILE * NEWFS_DATA_SIZE) {
+            fsck_problem(false, "inode %d: bad compressed size %d", ino, d->csize);
+            return;
+        }
+        need = NEWFS_ROUND_UP(d->csize, NEWFS_DATA_SIZE) / NEWFS_DATA_SIZE;
+    }
+    for (int i = 0; i < need; i++) {
+        if (d->block_pointer[i] < 0) {
+            fsck_problem(false, "inode %d: compressed extent block %d missing", ino, i);
+        }
+    }
+}
+
+static void fsck_load_range(int lo, int hi) {
+    for (int ino = lo; ino < hi; ino++) {
+        if (FSCK_BIT_TEST(fsck_map_inode, ino)) {
+            fsck_load_inode(ino);
+        }
+    }
+}
+
+/**
+ * @brief 从根目录与各快照根遍历，标记可达inode；位图中未分配但被引用的inode此时补读。
+ * 快照与活动树共享子inode，同一inode可被多个目录项指向，每个inode只向下展开一次
+ *
+ * @return int 0成功，根目录损坏时返回-NEWFS_ERROR_IO
+ */
+static int fsck_walk(void) {
+    int* queue = (int *)malloc(fsck_super.max_ino * sizeof(int));
+    int  head = 0, tail = 0, ino;
+    struct fsck_inode* dir;
+    struct fsck_inode* child;
+
+    if (!fsck_inodes[0].loaded) {
+        fsck_problem(true, "root inode free in inode map");
+        FSCK_BIT_SET(fsck_map_inode, 0);
+        fsck_maps_dirty = true;
+        fsck_load_inode(0);
+    }
+    if (fsck_inodes[0].err & (FSCK_E_READ | FSCK_E_RECORD) || fsck_inodes[0].d.ftype != NEWFS_DIR) {
+        fsck_problem(false, "root inode is not a directory");
+        free(queue);
+        return -NEWFS_ERROR_IO;
+    }
+    fsck_inodes[0].reachable = true;
+    fsck_inodes[0].links     = 1;
+    queue[tail++]            = 0;
+    for (int slot = 0; slot < NEWFS_SNAP_MAX; slot++) {
+        ino = fsck_super.snaps[slot].ino;
+        if (ino == 0) {
+            continue;
+        }
+        if (ino < 0 || ino >= fsck_super.max_ino || fsck_inodes[ino].reachable) {
+            fsck_problem(false, "snapshot %.*s: bad root inode %d", NEWFS_SNAP_NAME, fsck_super.snaps[slot].name, ino);
+            continue;
+        }
+        if (!fsck_inodes[ino].loaded) {
+            fsck_problem(true, "inode %d: snapshot root free in inode map", ino);
+            FSCK_BIT_SET(fsck_map_inode, ino);
+            fsck_maps_dirty = true;
+            fsck_load_inode(ino);
+        }
+        if (fsck_inodes[ino].bad || fsck_inodes[ino].d.ftype != NEWFS_DIR) {
+            fsck_problem(false, "snapshot %.*s: root inode %d is not a directory",
+                         NEWFS_SNAP_NAME, fsck_super.snaps[slot].name, ino);
+        }
+        fsck_inodes[ino].reachable = true;
+        fsck_inodes[ino].links     = 1;
+        if (!fsck_inodes[ino].bad) {
+            queue[tail++] = ino;
+        }
+    }
+    while (head < tail) {
+        dir = &fsck_inodes[queue[head++]];
+        for (int i = 0; i < dir->nchild; i++) {
+            child = &fsck_inodes[dir->child[i]];
+            if (!child->loaded) {
+                fsck_problem(true, "inode %d: in use but free in inode map", dir->child[i]);
+                FSCK_BIT_SET(fsck_map_inode, dir->child[i]);
+                fsck_maps_dirty = true;
+                fsck_load_inode(dir->child[i]);
+            }
+            if (!child->bad && child->d.ftype != dir->child_ftype[i]) {
+                fsck_problem(false, "inode %d: entry type %d differs from inode type %d",
+                             dir->child[i], dir->child_ftype[i], child->d.ftype);
+            }
+            if (child->links++ > 0) {
+                continue;
+            }
+            child->reachable = true;
+            if (!child->bad && child->d.ftype == NEWFS_DIR) {
+                queue[tail++] = dir->child[i];
+            }
+        }
+    }
+    free(queue);
+    return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 统计可达inode对数据块的引用，并清除不可达却已分配的inode
+ *
+ * @param lo
+ * @param hi
+ */
+static void fsck_count_range(int lo, int hi) {
+    struct fsck_inode* inode;
+    for (int ino = lo; ino < hi; ino++) {
+        inode = &fsck_inodes[ino];
+        if (!inode->reachable) {
+            if (FSCK_BIT_TEST(fsck_map_inode, ino)) {
+                fsck_problem(true, "inode %d: unreachable (leaked)", ino);
+                FSCK_BIT_CLR(fsck_map_inode, ino);
+                fsck_maps_dirty = true;
+            }
+            fsck_map_iref[ino] = 0;
+            continue;
+        }
+        if (inode->links - 1 > NEWFS_IREF_MAX) {
+            fsck_problem(false, "inode %d: linked from %d directory entries", ino, inode->links);
+        }
+        else if (fsck_map_iref[ino] != inode->links - 1) {
+            fsck_problem(true, "inode %d: iref map says %d extra references, found %d",
+                         ino, fsck_map_iref[ino], inode->links - 1);
+            fsck_map_iref[ino] = (uint8_t)(inode->links - 1);
+            fsck_maps_dirty    = true;
+        }
+        fsck_check_inode(ino);
+        if (inode->bad) {
+            continue;
+        }
+        for (int i = 0; i < NEWFS_DATA_PER_FILE; i++) {
+            if (inode->d.block_pointer[i] >= 0) {
+                __atomic_fetch_add(&fsck_refs[inode->d.block_pointer[i]], 1, __ATOMIC_RELAXED);
+            }
+        }
+        if (inode->d.xattr_blk >= 0) {
+            __atomic_fetch_add(&fsck_refs[inode->d.xattr_blk], 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/**
+ * @brief 以引用数核对data位图与引用计数表，可选核对校验和
+ *
+ * @param lo
+ * @param hi
+ */
+static void fsck_data_range(int lo, int hi) {
+    uint8_t  blk_buf[NEWFS_DATA_SIZE];
+    uint32_t refs;
+    for (int blk = lo; blk < hi; blk++) {
+        refs = fsck_refs[blk];
+        if (refs == 0) {
+            if (FSCK_BIT_TEST(fsck_map_data, blk)) {
+                fsck_problem(true, "data block %d: allocated but unreferenced (leaked)", blk);
+                FSCK_BIT_CLR(fsck_map_data, blk);
+                fsck_map_ref[blk] = 0;
+                fsck_maps_dirty   = true;
+            }
+            continue;
+        }
+        if (!FSCK_BIT_TEST(fsck_map_data, blk)) {
+            fsck_problem(true, "data block %d: in use but free in data map", blk);
+            FSCK_BIT_SET(fsck_map_data, blk);
+            fsck_maps_dirty = true;
+        }
+        if (refs - 1 > NEWFS_REF_MAX) {
+            fsck_problem(false, "data block %d: %u references exceed the ref map limit", blk, refs);
+        }
+        else if (fsck_map_ref[blk] != refs - 1) {
+            fsck_problem(true, "data block %d: ref map says %d extra references, found %u",
+                         blk, fsck_map_ref[blk], refs - 1);
+            fsck_map_ref[blk] = (uint8_t)(refs - 1);
+            fsck_maps_dirty   = true;
+        }
+        if (fsck_csum) {
+            if (fsck_read(fsck_data_ofs(blk), blk_buf, NEWFS_DATA_SIZE) != NEWFS_ERROR_NONE) {
+                fsck_problem(false, "data block %d: read error", blk);
+            }
+            else if (newfs_crc32c(blk_buf, NEWFS_DATA_SIZE) != fsck_map_csum[blk]) {
+                fsck_problem(false, "data block %d: checksum mismatch", blk);
+            }
+        }
+    }
+}
+
+/**
+ * @brief 读超级块与各张表，检查布局是否落在镜像内
+ *
+ * @param image_sz 镜像大小
+ * @return int
+ */
+static int fsck_load_super(off_t image_sz) {
+    if (fsck_read(NEWFS_SUPER_OFS, &fsck_super, sizeof(struct newfs_super_d)) != NEWFS_ERROR_NONE) {
+        return -NEWFS_ERROR_IO;
+    }
+    if (fsck_super.magic_num == NEWFS_MAGIC_NUM_V1) {
+        fprintf(stderr, "old newfs layout (magic 0x%x), reformat the image\n", fsck_super.magic_num);
+        return -NEWFS_ERROR_INVAL;
+    }
+    if (fsck_super.magic_num != NEWFS_MAGIC_NUM) {
+        fprintf(stderr, "bad magic 0x%x, not a newfs image\n", fsck_super.magic_num);
+        return -NEWFS_ERROR_INVAL;
+    }
+    if (fsck_super.max_ino <= 0 || fsck_super.max_data <= 0 ||
+        fsck_super.map_inode_blks * NEWFS_BLOCK_SIZE * UINT8_BITS < fsck_super.max_ino ||
+        fsck_super.map_data_blks * NEWFS_BLOCK_SIZE * UINT8_BITS < fsck_super.max_data ||
+        fsck_super.map_ref_blks * NEWFS_BLOCK_SIZE < fsck_super.max_data ||
+        fsck_super.map_csum_blks * NEWFS_BLOCK_SIZE < fsck_super.max_data * (int)sizeof(uint32_t) ||
+        fsck_super.map_iref_blks * NEWFS_BLOCK_SIZE < fsck_super.max_ino ||
+        fsck_inode_ofs(fsck_super.max_ino) > fsck_super.data_offset ||
+        fsck_data_ofs(fsck_super.max_data) > image_sz) {
+        fprintf(stderr, "superblock layout does not fit the image\n");
+        return -NEWFS_ERROR_INVAL;
+    }
+    fsck_map_inode = (uint8_t *)malloc(fsck_super.map_inode_blks * NEWFS_BLOCK_SIZE);
+    fsck_map_data  = (uint8_t *)malloc(fsck_super.map_data_blks * NEWFS_BLOCK_SIZE);
+    fsck_map_ref   = (uint8_t *)malloc(fsck_super.map_ref_blks * NEWFS_BLOCK_SIZE);
+    fsck_map_csum  = (uint32_t *)malloc(fsck_super.map_csum_blks * NEWFS_BLOCK_SIZE);
+    fsck_map_iref  = (uint8_t *)malloc(fsck_super.map_iref_blks * NEWFS_BLOCK_SIZE);
+    if (fsck_read(fsck_super.map_inode_offset, fsck_map_inode, fsck_super.map_inode_blks * NEWFS_BLOCK_SIZE) ||
+        fsck_read(fsck_super.map_data_offset, fsck_map_data, fsck_super.map_data_blks * NEWFS_BLOCK_SIZE) ||
+        fsck_read(fsck_super.map_ref_offset, fsck_map_ref, fsck_super.map_ref_blks * NEWFS_BLOCK_SIZE) ||
+        fsck_read(fsck_super.map_csum_offset, fsck_map_csum, fsck_super.map_csum_blks * NEWFS_BLOCK_SIZE) ||
+        fsck_read(fsck_super.map_iref_offset, fsck_map_iref, fsck_super.map_iref_blks * NEWFS_BLOCK_SIZE)) {
+        return -NEWFS_ERROR_IO;
+    }
+    return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 写回修复后的位图、引用计数表、超级块与inode记录
+ *
+ * @return int
+ */
+static int fsck_write_back(void) {
+    for (int ino = 0; ino < fsck_super.max_ino; ino++) {
+        if (fsck_inodes[ino].dirty && fsck_inodes[ino].reachable &&
+            fsck_write(fsck_inode_ofs(ino), &fsck_inodes[ino].d, sizeof(struct newfs_inode_d))) {
+            return -NEWFS_ERROR_IO;
+        }
+    }
+    if (!fsck_maps_dirty) {
+        return NEWFS_ERROR_NONE;
+    }
+    if (fsck_write(fsck_super.map_inode_offset, fsck_map_inode, fsck_super.map_inode_blks * NEWFS_BLOCK_SIZE) ||
+        fsck_write(fsck_super.map_data_offset, fsck_map_data, fsck_super.map_data_blks * NEWFS_BLOCK_SIZE) ||
+        fsck_write(fsck_super.map_ref_offset, fsck_map_ref, fsck_super.map_ref_blks * NEWFS_BLOCK_SIZE) ||
+        fsck_write(fsck_super.map_iref_offset, fsck_map_iref, fsck_super.map_iref_blks * NEWFS_BLOCK_SIZE) ||
+        fsck_write(NEWFS_SUPER_OFS, &fsck_super, sizeof(struct newfs_super_d))) {
+        return -NEWFS_ERROR_IO;
+    }
+    return fsync(fsck_fd) == 0 ? NEWFS_ERROR_NONE : -NEWFS_ERROR_IO;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "usage: %s [-r] [-c] [-j threads] [-v] [image]\n"
+                    "  image  newfs disk image, default ~/ddriver\n"
+                    "  -r     repair (image must not be mounted)\n"
+                    "  -c     also verify data block checksums\n"
+                    "  -j     worker threads, default number of CPUs\n", prog);
+}
+
+int main(int argc, char** argv) {
+    char            default_image[4096];
+    const char*     image;
+    struct stat     st;
+    struct timespec start, end;
+    int             opt, reachable = 0, used = 0, ret;
+
+    fsck_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "rcj:vh")) != -1) {
+        switch (opt) {
+        case 'r': fsck_repair  = true;          break;
+        case 'c': fsck_csum    = true;          break;
+        case 'j': fsck_threads = atoi(optarg);  break;
+        case 'v': fsck_verbose = true;          break;
+        default:  usage(argv[0]); return opt == 'h' ? FSCK_EXIT_OK : FSCK_EXIT_OPERATIONAL;
+        }
+    }
+    if (fsck_threads < 1) {
+        fsck_threads = 1;
+    }
+    if (fsck_threads > FSCK_MAX_THREADS) {
+        fsck_threads = FSCK_MAX_THREADS;
+    }
+    snprintf(default_image, sizeof(default_image), "%s/ddriver", getenv("HOME") ? getenv("HOME") : ".");
+    image = optind < argc ? argv[optind] : default_image;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fsck_fd = open(image, fsck_repair ? O_RDWR : O_RDONLY);
+    if (fsck_fd < 0 || fstat(fsck_fd, &st) != 0) {
+        perror(image);
+        return FSCK_EXIT_OPERATIONAL;
+    }
+    if (fsck_load_super(st.st_size) != NEWFS_ERROR_NONE) {
+        return FSCK_EXIT_OPERATIONAL;
+    }
+    newfs_crc32c_init();
+    fsck_inodes = (struct fsck_inode *)calloc(fsck_super.max_ino, sizeof(struct fsck_inode));
+    fsck_refs   = (uint32_t *)calloc(fsck_super.max_data, sizeof(uint32_t));
+
+    fsck_parallel(fsck_super.max_ino, fsck_load_range);           /* 阶段1 */
+    if (fsck_walk() != NEWFS_ERROR_NONE) {                        /* 阶段2 */
+        return FSCK_EXIT_UNCORRECTED;
+    }
+    fsck_parallel(fsck_super.max_ino, fsck_count_range);          /* 阶段3 */
+    fsck_parallel(fsck_super.max_data, fsck_data_range);          /* 阶段4 */
+    for (int blk = 0; blk < fsck_super.max_data; blk++) {
+        used += FSCK_BIT_TEST(fsck_map_data, blk) ? 1 : 0;
+    }
+    if (fsck_super.sz_usage != used * NEWFS_BLOCK_SIZE) {
+        fsck_problem(true, "superblock usage %d, counted %d", fsck_super.sz_usage, used * NEWFS_BLOCK_SIZE);
+        fsck_super.sz_usage = used * NEWFS_BLOCK_SIZE;
+        fsck_maps_dirty     = true;
+    }
+
+    if (fsck_repair && fsck_write_back() != NEWFS_ERROR_NONE) {
+        fprintf(stderr, "%s: write back failed\n", image);
+        return FSCK_EXIT_OPERATIONAL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (int ino = 0; ino < fsck_super.max_ino; ino++) {
+        reachable += fsck_inodes[ino].reachable ? 1 : 0;
+    }
+    printf("%s: %d/%d inodes, %d/%d data blocks, %d problems fixed, %d left, "
+           "%d threads, %.3f s\n", image, reachable, fsck_super.max_ino, used, fsck_super.max_data,
+           fsck_fixed, fsck_left, fsck_threads,
+           (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    if (fsck_verbose) {
+        printf("layout: inode map @%d (%d blks), data map @%d (%d blks), ref map @%d (%d blks), "
+               "csum map @%d (%d blks), iref map @%d (%d blks), inodes @%d, data @%d\n",
+               fsck_super.map_inode_offset, fsck_super.map_inode_blks, fsck_super.map_data_offset,
+               fsck_super.map_data_blks, fsck_super.map_ref_offset, fsck_super.map_ref_blks,
+               fsck_super.map_csum_offset, fsck_super.map_csum_blks, fsck_super.map_iref_offset,
+               fsck_super.map_iref_blks, fsck_super.inode_offset,
+               fsck_super.data_offset);
+    }
+    close(fsck_fd);
+    ret = fsck_left != 0 ? FSCK_EXIT_UNCORRECTED : (fsck_fixed != 0 ? FSCK_EXIT_FIXED : FSCK_EXIT_OK);
+    return ret;
+}
@@ -0,0 +1,173 @@
+#include "newfs.h"
+#include <getopt.h>
+#include <limits.h>
+
+/******************************************************************************
+* SECTION: grow.newfs
+*
+* 扩展newfs磁盘镜像，新布局由newfs_layout_grow计算，与newfs在线扩容一致：
+* 数据区向后延伸，data位图、引用计数表、校验和表容量不足时迁到镜像末尾，
+* 已有数据块不移动，写入量只与表的大小有关。
+*   离线：grow.newfs size [image]，扩展镜像文件，写入迁移后的表，最后写超级块
+*   在线：grow.newfs -m mountpoint size [image]，扩展镜像文件后对挂载点根目录
+*         设置NEWFS_GROW_XATTR，由newfs更新内存中的表并写回（挂载期间newfs
+*         会在卸载时覆盖镜像上的元数据，不能直接改镜像）
+*******************************************************************************/
+static int grow_fd = -1;
+
+static int grow_read(off_t offset, void* buf, int size) {
+    return pread(grow_fd, buf, size, offset) == size ? NEWFS_ERROR_NONE : -NEWFS_ERROR_IO;
+}
+
+static int grow_write(off_t offset, const void* buf, int size) {
+    return pwrite(grow_fd, buf, size, offset) == size ? NEWFS_ERROR_NONE : -NEWFS_ERROR_IO;
+}
+
+/**
+ * @brief 解析带K/M/G后缀的字节数
+ *
+ * @param arg
+ * @return long 非法时返回-1
+ */
+static long grow_parse_size(const char* arg) {
+    char* end;
+    long  size = strtol(arg, &end, 0);
+    switch (*end) {
+    case 'G': case 'g': size <<= 10;    /* fall through */
+    case 'M': case 'm': size <<= 10;    /* fall through */
+    case 'K': case 'k': size <<= 10; end++; break;
+    default:  break;
+    }
+    return *end == '\0' && size > 0 ? size : -1;
+}
+
+/**
+ * @brief 把旧表读入按新大小分配的缓冲区，新增部分为0
+ *
+ * @param offset 旧表位置
+ * @param old_blks 旧表块数
+ * @param blks 新表块数
+ * @return uint8_t* 读失败返回NULL
+ */
+static uint8_t* grow_load_map(int offset, int old_blks, int blks) {
+    uint8_t* map = (uint8_t *)calloc(blks, NEWFS_BLOCK_SIZE);
+    if (grow_read(offset, map, old_blks * NEWFS_BLOCK_SIZE) != NEWFS_ERROR_NONE) {
+        free(map);
+        return NULL;
+    }
+    return map;
+}
+
+/**
+ * @brief 离线扩容：先把三张表写到新位置，再写超级块切换布局
+ *
+ * @param super 当前超级块
+ * @param size 新的镜像大小
+ * @return int
+ */
+static int grow_offline(struct newfs_super_d* super, long size) {
+    struct newfs_super_d layout = *super;
+    uint8_t* map_data;
+    uint8_t* map_ref;
+    uint8_t* map_csum;
+    int      ret;
+
+    ret = newfs_layout_grow(&layout, size);
+    if (ret != NEWFS_ERROR_NONE) {
+        fprintf(stderr, "%ld bytes leaves no room for more data blocks\n", size);
+        return ret;
+    }
+    map_data = grow_load_map(super->map_data_offset, super->map_data_blks, layout.map_data_blks);
+    map_ref  = grow_load_map(super->map_ref_offset, super->map_ref_blks, layout.map_ref_blks);
+    map_csum = grow_load_map(super->map_csum_offset, super->map_csum_blks, layout.map_csum_blks);
+    if (map_data == NULL || map_ref == NULL || map_csum == NULL) {
+        return -NEWFS_ERROR_IO;
+    }
+    if (ftruncate(grow_fd, size) != 0 ||
+        grow_write(layout.map_data_offset, map_data, layout.map_data_blks * NEWFS_BLOCK_SIZE) ||
+        grow_write(layout.map_ref_offset, map_ref, layout.map_ref_blks * NEWFS_BLOCK_SIZE) ||
+        grow_write(layout.map_csum_offset, map_csum, layout.map_csum_blks * NEWFS_BLOCK_SIZE) ||
+        fsync(grow_fd) != 0 ||
+        grow_write(NEWFS_SUPER_OFS, &layout, sizeof(struct newfs_super_d)) ||
+        fsync(grow_fd) != 0) {
+        return -NEWFS_ERROR_IO;
+    }
+    printf("data blocks %d -> %d, data map @%d, ref map @%d, csum map @%d\n",
+           super->max_data, layout.max_data, layout.map_data_offset,
+           layout.map_ref_offset, layout.map_csum_offset);
+    free(map_data);
+    free(map_ref);
+    free(map_csum);
+    return NEWFS_ERROR_NONE;
+}
+
+/**
+ * @brief 在线扩容：扩展镜像文件后通知挂载中的newfs
+ *
+ * @param mountpoint
+ * @param size
+ * @return int
+ */
+static int grow_online(const char* mountpoint, long size) {
+    char value[32];
+    int  len = snprintf(value, sizeof(value), "%ld", size);
+    if (setxattr(mountpoint, NEWFS_GROW_XATTR, value, len, 0) != 0) {
+        perror(mountpoint);
+        return -NEWFS_ERROR_IO;
+    }
+    printf("%s: grown to %ld bytes\n", mountpoint, size);
+    return NEWFS_ERROR_NONE;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "usage: %s [-m mountpoint] size[K|M|G] [image]\n"
+                    "  image  newfs disk image, default ~/ddriver\n"
+                    "  -m     the image is mounted there, let newfs switch the layout\n", prog);
+}
+
+int main(int argc, char** argv) {
+    char                 default_image[4096];
+    const char*          image;
+    const char*          mountpoint = NULL;
+    struct newfs_super_d super;
+    struct stat          st;
+    long                 size;
+    int                  opt;
+
+    while ((opt = getopt(argc, argv, "m:h")) != -1) {
+        switch (opt) {
+        case 'm': mountpoint = optarg; break;
+        default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc || (size = grow_parse_size(argv[optind])) < 0 || size > INT_MAX) {
+        usage(argv[0]);
+        return 1;
+    }
+    snprintf(default_image, sizeof(default_image), "%s/ddriver", getenv("HOME") ? getenv("HOME") : ".");
+    image = optind + 1 < argc ? argv[optind + 1] : default_image;
+
+    grow_fd = open(image, O_RDWR);
+    if (grow_fd < 0 || fstat(grow_fd, &st) != 0) {
+        perror(image);
+        return 1;
+    }
+    if (grow_read(NEWFS_SUPER_OFS, &super, sizeof(struct newfs_super_d)) != NEWFS_ERROR_NONE ||
+        super.magic_num != NEWFS_MAGIC_NUM) {
+        fprintf(stderr, "%s: not a newfs image\n", image);
+        return 1;
+    }
+    if (size < st.st_size) {
+        fprintf(stderr, "%s: shrinking is not supported (image is %ld bytes)\n", image, (long)st.st_size);
+        return 1;
+    }
+
+    if (mountpoint != NULL) {
+        if (ftruncate(grow_fd, size) != 0) {
+            perror(image);
+            return 1;
+        }
+        return grow_online(mountpoint, size) == NEWFS_ERROR_NONE ? 0 : 1;
+    }
+    return grow_offline(&super, size) == NEWFS_ERROR_NONE ? 0 : 1;
+}